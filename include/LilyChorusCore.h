@@ -0,0 +1,112 @@
+#ifndef LILYCHORUS_CORE_H
+#define LILYCHORUS_CORE_H
+
+/*
+    C API for running the LilyChorus DSP without a plugin host.
+
+    All processing happens in place on buffers owned by the caller. Planar
+    buffers are handed to the DSP as they are, interleaved ones are
+    deinterleaved a block at a time through scratch memory allocated in
+    lilychorus_prepare(), so no call after prepare allocates.
+
+    An instance is not thread safe: calls on the same instance must not overlap.
+    Separate instances are independent.
+*/
+
+#include <stdint.h>
+
+#if defined(_WIN32)
+#if defined(LILYCHORUS_CORE_BUILD)
+#define LILYCHORUS_API __declspec(dllexport)
+#else
+#define LILYCHORUS_API __declspec(dllimport)
+#endif
+#else
+#define LILYCHORUS_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Bumped whenever a function or struct changes in an incompatible way */
+#define LILYCHORUS_API_VERSION 2
+
+    typedef struct lilychorus lilychorus;
+
+    typedef enum lilychorus_status
+    {
+        LILYCHORUS_OK = 0,
+        LILYCHORUS_ERROR_INVALID_ARGUMENT = -1,
+        LILYCHORUS_ERROR_NOT_PREPARED = -2,
+        LILYCHORUS_ERROR_WRONG_PRECISION = -3,
+        LILYCHORUS_ERROR_TOO_MANY_CHANNELS = -4,
+        LILYCHORUS_ERROR_OUT_OF_MEMORY = -5
+    } lilychorus_status;
+
+    typedef enum lilychorus_precision
+    {
+        LILYCHORUS_FLOAT32 = 0,
+        LILYCHORUS_FLOAT64 = 1
+    } lilychorus_precision;
+
+    /*
+        Everything the plugin exposes as a parameter, in the same units and ranges.
+        Out of range values are clamped. Always fill this in with
+        lilychorus_default_params() first so struct_size is set; fields added in
+        later versions then keep their defaults for older callers.
+    */
+    typedef struct lilychorus_params
+    {
+        uint32_t struct_size;
+
+        double rate;            /* Hz, 0.01 to 10 */
+        double rate_spread;     /* 0.01 to 1 */
+        double depth;           /* 0 to 1 */
+        double mix;             /* 0 (dry) to 1 (wet) */
+        double delay_ms;        /* 1 to 50 */
+        double spread;          /* 0.5 (centre) to 1 (wide) */
+        double highpass_cutoff; /* Hz, 50 to 2000 */
+        double feedback;        /* 0 to 1 */
+        int32_t enable_highpass;
+        int32_t invert_feedback;
+        int32_t invert;
+        int32_t pan_law; /* 0 linear, 1 equal power */
+    } lilychorus_params;
+
+    LILYCHORUS_API uint32_t lilychorus_api_version(void);
+
+    /* Instruction set the DSP kernels run on in this process, e.g. "avx2" */
+    LILYCHORUS_API const char *lilychorus_simd_path(void);
+
+    /* Returns NULL if the instance could not be allocated */
+    LILYCHORUS_API lilychorus *lilychorus_create(lilychorus_precision precision);
+    LILYCHORUS_API void lilychorus_destroy(lilychorus *instance);
+
+    /* Allocates everything the instance needs. Blocks longer than max_block_size are split up internally.
+       The chorus starts from silence, unless keep_state is non-zero and the instance was already prepared
+       with the same sample rate and channel count: then it carries on from where it was, and nothing is
+       allocated unless max_block_size grew. keep_state was added in API version 2.
+       Mono and stereo are supported; more than 2 channels gives LILYCHORUS_ERROR_TOO_MANY_CHANNELS.
+       On LILYCHORUS_ERROR_OUT_OF_MEMORY an instance that was prepared before stays prepared, with its
+       previous block size and channel count. */
+    LILYCHORUS_API lilychorus_status lilychorus_prepare(lilychorus *instance, double sample_rate, uint32_t max_block_size, uint32_t num_channels, int32_t keep_state);
+    LILYCHORUS_API lilychorus_status lilychorus_reset(lilychorus *instance);
+
+    LILYCHORUS_API void lilychorus_default_params(lilychorus_params *params);
+    LILYCHORUS_API lilychorus_status lilychorus_set_params(lilychorus *instance, const lilychorus_params *params);
+
+    /* channels[c] points at num_frames samples of channel c */
+    LILYCHORUS_API lilychorus_status lilychorus_process_planar_f32(lilychorus *instance, float *const *channels, uint32_t num_channels, uint32_t num_frames);
+    LILYCHORUS_API lilychorus_status lilychorus_process_planar_f64(lilychorus *instance, double *const *channels, uint32_t num_channels, uint32_t num_frames);
+
+    /* samples holds num_frames frames of num_channels interleaved samples */
+    LILYCHORUS_API lilychorus_status lilychorus_process_interleaved_f32(lilychorus *instance, float *samples, uint32_t num_channels, uint32_t num_frames);
+    LILYCHORUS_API lilychorus_status lilychorus_process_interleaved_f64(lilychorus *instance, double *samples, uint32_t num_channels, uint32_t num_frames);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
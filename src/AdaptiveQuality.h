@@ -0,0 +1,69 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+// Opt-in load watcher for the processor. It compares how long each block took
+// to process with how long the block lasts. When that share climbs it steps the
+// chorus quality down, and once it has stayed low for a while it steps back up.
+// Spikes count straight away, recovery is deliberately slow so it doesn't flap.
+class AdaptiveQuality
+{
+public:
+    explicit AdaptiveQuality(int numLevelsToUse) : numLevels(numLevelsToUse) {}
+
+    void prepare(double newSampleRate)
+    {
+        sampleRate = newSampleRate;
+        reset();
+    }
+
+    void reset()
+    {
+        level = 0;
+        smoothedLoad = 0.0;
+        secondsAtLevel = 0.0;
+    }
+
+    // Feed in the time the last block took, get back the quality level for the next one
+    int update(double secondsTaken, int numSamples)
+    {
+        if (numSamples <= 0 || sampleRate <= 0.0)
+            return level;
+
+        const double budget = numSamples / sampleRate;
+        const double load = secondsTaken / budget;
+        smoothedLoad += (load - smoothedLoad) * (load > smoothedLoad ? attack : release);
+        secondsAtLevel += budget;
+
+        if (smoothedLoad > stepDownLoad && level < numLevels - 1 && secondsAtLevel >= stepDownHoldSeconds)
+        {
+            ++level;
+            secondsAtLevel = 0.0;
+        }
+        else if (smoothedLoad < stepUpLoad && level > 0 && secondsAtLevel >= stepUpHoldSeconds)
+        {
+            --level;
+            secondsAtLevel = 0.0;
+        }
+
+        return level;
+    }
+
+    int getLevel() const noexcept { return level; }
+    double getLoad() const noexcept { return smoothedLoad; }
+
+private:
+    // Loads are the fraction of the block's real-time duration spent processing it
+    static constexpr double attack = 0.5,
+                            release = 0.05,
+                            stepDownLoad = 0.5,
+                            stepUpLoad = 0.2,
+                            stepDownHoldSeconds = 0.05,
+                            stepUpHoldSeconds = 2.0;
+
+    int numLevels;
+    int level = 0;
+    double sampleRate = 44100.0;
+    double smoothedLoad = 0.0;
+    double secondsAtLevel = 0.0;
+};
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+#include <algorithm>
+
+#include "InstanceArena.h"
+#include "SimdDispatch.h"
+
+// Multichannel delay with third order Lagrange reads, like
+// juce::dsp::DelayLine<..., Lagrange3rd>, but working a block at a time so
+// reads and writes go through the dispatched SIMD kernels.
+template <typename SampleType>
+class ChorusDelayLine
+{
+public:
+    // Length of the ring each channel needs, a power of two
+    static size_t getRingSize(size_t maximumDelayInSamples, size_t maximumBlockSize)
+    {
+        // A whole block is written before it is read when there is no feedback,
+        // so the ring has to hold a block on top of the longest delay.
+        size_t size = 1;
+        while (size < maximumDelayInSamples + maximumBlockSize + 4)
+            size <<= 1;
+
+        return size;
+    }
+
+    // Where a line's memory lives in its arena
+    struct Memory
+    {
+        SampleType **channels = nullptr;
+        uint32_t *writePosition = nullptr;
+        size_t numChannels = 0;
+        size_t ringSize = 0;
+    };
+
+    // Takes a line's memory from the arena: one ring per channel, each given its own
+    // colour from firstColour up so rings of different voices don't alias. No line is
+    // touched, and the pointers are null while the arena is only measuring.
+    static Memory take(InstanceArena &arena, size_t numChannels, size_t ringSize, size_t firstColour)
+    {
+        Memory memory;
+        memory.channels = arena.take<SampleType *>(numChannels);
+        memory.writePosition = arena.take<uint32_t>(numChannels);
+        memory.numChannels = numChannels;
+        memory.ringSize = ringSize;
+
+        for (size_t channel = 0; channel < numChannels; ++channel)
+        {
+            auto *ring = arena.take<SampleType>(ringSize, firstColour + channel);
+            if (memory.channels != nullptr)
+                memory.channels[channel] = ring;
+        }
+
+        return memory;
+    }
+
+    // Moves the line onto memory taken for it. freshMemory says the arena came straight
+    // from the OS, zeroed, in which case nothing is touched until the line is first
+    // written, so instances that are prepared but never play stay cheap.
+    void prepare(const Memory &memoryToUse, size_t minimumDelayInSamples, bool freshMemory)
+    {
+        memory = memoryToUse;
+        mask = static_cast<uint32_t>(memory.ringSize - 1);
+
+        // With feedback every read has to be of samples written before the chunk
+        feedbackChunk = juce::jmax((size_t)1, minimumDelayInSamples - 1);
+
+        hasHistory = !freshMemory;
+        reset();
+    }
+
+    void reset()
+    {
+        if (hasHistory)
+        {
+            for (size_t channel = 0; channel < memory.numChannels; ++channel)
+                std::fill(memory.channels[channel], memory.channels[channel] + memory.ringSize, static_cast<SampleType>(0));
+
+            hasHistory = false;
+        }
+
+        std::fill(memory.writePosition, memory.writePosition + memory.numChannels, 0u);
+    }
+
+    using TapReader = decltype(simd::Kernels<SampleType>::interpolateTaps);
+
+    // Writes input (plus taps * feedback) into the channel's history and reads one tap
+    // per sample at delays[i] samples with the given reader. Delays must be at least
+    // minimumDelayInSamples. If fadeFrom is set, the taps crossfade from that reader
+    // to the new one over the block, using fadeScratch for the old reader's output.
+    template <bool withFeedback>
+    void process(const simd::Kernels<SampleType> &kernels, size_t channel, const SampleType *input,
+                 const SampleType *delays, SampleType *taps, size_t numSamples, SampleType feedback,
+                 TapReader read, TapReader fadeFrom = nullptr, SampleType *fadeScratch = nullptr) noexcept
+    {
+        auto *samples = memory.channels[channel];
+        auto &position = memory.writePosition[channel];
+        hasHistory = true;
+
+        if constexpr (withFeedback)
+        {
+            for (size_t start = 0; start < numSamples; start += feedbackChunk)
+            {
+                const auto count = juce::jmin(feedbackChunk, numSamples - start);
+                const auto chunkPosition = position + static_cast<uint32_t>(start);
+                readTaps(kernels, samples, chunkPosition, delays + start, taps + start, count, start, numSamples, read, fadeFrom, fadeScratch);
+                kernels.writeDelay(samples, mask, chunkPosition, input + start, taps + start, feedback, count);
+            }
+        }
+        else
+        {
+            juce::ignoreUnused(feedback);
+            kernels.writeDelay(samples, mask, position, input, nullptr, static_cast<SampleType>(0), numSamples);
+            readTaps(kernels, samples, position, delays, taps, numSamples, 0, numSamples, read, fadeFrom, fadeScratch);
+        }
+
+        position = (position + static_cast<uint32_t>(numSamples)) & mask;
+    }
+
+    // Keeps the channel's history going without reading from it, for voices that are switched off
+    void write(const simd::Kernels<SampleType> &kernels, size_t channel, const SampleType *input, size_t numSamples) noexcept
+    {
+        auto &position = memory.writePosition[channel];
+        hasHistory = true;
+        kernels.writeDelay(memory.channels[channel], mask, position, input, nullptr, static_cast<SampleType>(0), numSamples);
+        position = (position + static_cast<uint32_t>(numSamples)) & mask;
+    }
+
+private:
+    void readTaps(const simd::Kernels<SampleType> &kernels, const SampleType *samples, uint32_t position,
+                  const SampleType *delays, SampleType *taps, size_t count, size_t offset, size_t total,
+                  TapReader read, TapReader fadeFrom, SampleType *fadeScratch) noexcept
+    {
+        read(samples, mask, position, delays, taps, count);
+
+        if (fadeFrom != nullptr)
+        {
+            fadeFrom(samples, mask, position, delays, fadeScratch + offset, count);
+
+            const SampleType step = static_cast<SampleType>(1) / static_cast<SampleType>(total);
+            const SampleType fade = step * static_cast<SampleType>(offset);
+            kernels.mixDryWet(taps, fadeScratch + offset, fade, step, 1 - fade, -step, count);
+        }
+    }
+
+    Memory memory;
+    uint32_t mask = 0;
+    size_t feedbackChunk = 1;
+    bool hasHistory = false;
+};
@@ -0,0 +1,155 @@
+#include "InstanceArena.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+    constexpr size_t hugePageSize = (size_t)2 << 20;
+
+    size_t alignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    bool wantsHugePages()
+    {
+        static const bool enabled = []
+        {
+            const char *value = std::getenv("LILYCHORUS_HUGE_PAGES");
+            return value != nullptr && std::strcmp(value, "1") == 0;
+        }();
+
+        return enabled;
+    }
+}
+
+InstanceArena::~InstanceArena()
+{
+    release();
+}
+
+void InstanceArena::startMeasuring()
+{
+    measuring = true;
+    used = 0;
+}
+
+void InstanceArena::startCarving()
+{
+    measuring = false;
+    used = 0;
+}
+
+void *InstanceArena::takeBytes(size_t bytes, size_t colour)
+{
+    size_t offset = alignUp(used, cacheLineSize);
+
+    if (colour != 0)
+    {
+        // Skip ahead to this colour's offset within the page
+        const size_t wanted = (colour * 3 * cacheLineSize) % pageSize;
+        offset += (wanted + pageSize - offset % pageSize) % pageSize;
+    }
+
+    used = offset + bytes;
+
+    if (measuring || used > capacity)
+        return nullptr;
+
+    return base + offset;
+}
+
+bool InstanceArena::reserve()
+{
+    const size_t needed = alignUp(used, cacheLineSize);
+    if (needed <= capacity && base != nullptr)
+        return false;
+
+    // The new block is mapped before the old one goes, so if that fails the arena,
+    // and everything carved from it, is left as it was
+    void *newMapping = nullptr;
+    size_t newMappingSize = 0;
+    unsigned char *newBase = nullptr;
+
+#if defined(_WIN32)
+    newMapping = _aligned_malloc(needed, cacheLineSize);
+    if (newMapping == nullptr)
+        throw std::bad_alloc();
+
+    // Windows has no lazily zeroed heap memory to ask for
+    std::memset(newMapping, 0, needed);
+    newBase = static_cast<unsigned char *>(newMapping);
+    newMappingSize = needed;
+#else
+#if defined(__linux__)
+    if (wantsHugePages())
+    {
+        // Explicit huge pages first, which only works if some have been reserved
+        newMappingSize = alignUp(needed, hugePageSize);
+        newMapping = mmap(nullptr, newMappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        if (newMapping != MAP_FAILED)
+        {
+            newBase = static_cast<unsigned char *>(newMapping);
+        }
+        else
+        {
+            // Otherwise ask for transparent huge pages, which need a 2MB aligned range
+            newMappingSize = alignUp(needed, hugePageSize) + hugePageSize;
+            newMapping = mmap(nullptr, newMappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+            if (newMapping != MAP_FAILED)
+            {
+                newBase = reinterpret_cast<unsigned char *>(alignUp(reinterpret_cast<uintptr_t>(newMapping), hugePageSize));
+                madvise(newBase, alignUp(needed, hugePageSize), MADV_HUGEPAGE);
+            }
+        }
+    }
+#endif
+
+    if (newBase == nullptr)
+    {
+        // Anonymous mappings are page aligned and come zeroed a page at a time, on first touch
+        newMappingSize = needed;
+        newMapping = mmap(nullptr, newMappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (newMapping == MAP_FAILED)
+            throw std::bad_alloc();
+
+        newBase = static_cast<unsigned char *>(newMapping);
+    }
+#endif
+
+    release();
+
+    mapping = newMapping;
+    mappingSize = newMappingSize;
+    base = newBase;
+    capacity = needed;
+    return true;
+}
+
+void InstanceArena::release()
+{
+    if (mapping != nullptr)
+    {
+#if defined(_WIN32)
+        _aligned_free(mapping);
+#else
+        munmap(mapping, mappingSize);
+#endif
+    }
+
+    base = nullptr;
+    mapping = nullptr;
+    mappingSize = 0;
+    capacity = 0;
+}
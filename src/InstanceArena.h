@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// One block of memory for everything a chorus instance works on, handed out in
+// cache line aligned pieces. Layout code runs twice: once measuring, where take()
+// only counts bytes and returns nullptr, then again for real once reserve() has
+// made room. Memory only ever grows, and fresh memory is zeroed lazily by the OS.
+//
+// Setting the LILYCHORUS_HUGE_PAGES environment variable to 1 backs arenas with
+// huge pages on Linux, where the kernel allows it.
+class InstanceArena
+{
+public:
+    static constexpr size_t cacheLineSize = 64;
+    static constexpr size_t pageSize = 4096;
+
+    InstanceArena() = default;
+    ~InstanceArena();
+
+    void startMeasuring();
+    void startCarving();
+
+    // Makes sure at least the measured size is available. Returns true if that took
+    // fresh, zeroed memory, false if the existing block was reused as it was.
+    // Throws std::bad_alloc if the memory can't be had, leaving the old block in place.
+    bool reserve();
+
+    // count objects, cache line aligned. Pieces given different colours start at
+    // different offsets within a 4K page, so streams read side by side don't alias.
+    template <typename Type>
+    Type *take(size_t count, size_t colour = 0)
+    {
+        return static_cast<Type *>(takeBytes(count * sizeof(Type), colour));
+    }
+
+    size_t getCapacity() const noexcept { return capacity; }
+
+private:
+    void *takeBytes(size_t bytes, size_t colour);
+    void release();
+
+    unsigned char *base = nullptr;
+    void *mapping = nullptr;
+    size_t mappingSize = 0;
+    size_t capacity = 0;
+    size_t used = 0;
+    bool measuring = true;
+
+    InstanceArena(const InstanceArena &) = delete;
+    InstanceArena &operator=(const InstanceArena &) = delete;
+};
@@ -19,7 +19,7 @@ public:
         label.setJustificationType(Justification::centredTop);
 
         addAndMakeVisible(slider);
-        slider.setLookAndFeel(&chickenKnob);
+        slider.setLookAndFeel(&chickenKnob.get());
         slider.addListener(this);
 
         addAndMakeVisible(valueLabel);
@@ -50,10 +50,13 @@ public:
     ~LabeledSlider()
     {
         stopTimer();
+        slider.setLookAndFeel(nullptr);
     }
 
 private:
-    ChickenKnobStyle chickenKnob;
+    // One knob style shared by every slider of every open editor, rather than one each.
+    // Only editors build it, so scans and sessions that never open one don't pay for it.
+    SharedResourcePointer<ChickenKnobStyle> chickenKnob;
     Label label;
     Label valueLabel;
     String units;
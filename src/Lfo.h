@@ -1,74 +1,139 @@
 #pragma once
 
 #include <math.h>
+#include <stddef.h>
 
-template <typename SampleType>
+#include "SimdDispatch.h"
+
+// A bank of quadrature oscillators, advanced side by side so the SIMD kernel
+// can run one oscillator per vector lane.
+template <typename SampleType, size_t numOscillators>
 class Lfo
 {
-    SampleType lfoX;
-    SampleType lfoY;
-    SampleType lfoE;
+    SampleType lfoX[numOscillators];
+    SampleType lfoY[numOscillators];
+    SampleType lfoE[numOscillators];
+    SampleType lfoRate[numOscillators];
+    SampleType lfoEControl[numOscillators];
+    SampleType rampValue[numOscillators];
+    SampleType rampStep[numOscillators];
+    size_t rampRemaining;
+    size_t samplesSinceNormalize;
     SampleType pi;
     SampleType twoPi;
-    SampleType lfoRate;
     SampleType sampleRate;
-    int normalizationCounter;
+    const simd::Kernels<SampleType> &kernels;
 
-    void updateLfo()
+    void updateLfo(size_t index)
     {
-        SampleType omega = twoPi * lfoRate / sampleRate;
-        lfoE = 2 * sin(omega / 2.0);
+        SampleType omega = twoPi * lfoRate[index] / sampleRate;
+        lfoE[index] = 2 * sin(omega / 2.0);
+        lfoEControl[index] = 2 * sin(omega * controlInterval / 2.0);
     }
 
     void normalize()
     {
-        SampleType magnitude = sqrt(lfoX * lfoX + lfoY * lfoY);
-        if (magnitude != 0.0)
+        for (size_t i = 0; i < numOscillators; ++i)
         {
-            lfoX /= magnitude;
-            lfoY /= magnitude;
+            SampleType magnitude = sqrt(lfoX[i] * lfoX[i] + lfoY[i] * lfoY[i]);
+            if (magnitude != 0.0)
+            {
+                lfoX[i] /= magnitude;
+                lfoY[i] /= magnitude;
+            }
         }
     }
 
 public:
-    Lfo() : lfoE(static_cast<SampleType>(0.0)),
+    // Oscillators step this many samples at a time at control rate
+    static constexpr size_t controlInterval = 16;
+
+    // Drift off the unit circle is slow, so the sqrt only needs paying this often
+    static constexpr size_t normalizeInterval = 1024;
+
+    Lfo() : rampRemaining(0),
+            samplesSinceNormalize(0),
             pi(2 * acos(static_cast<SampleType>(0.0))),
             twoPi(2 * pi),
-            lfoRate(static_cast<SampleType>(1.0)),
             sampleRate(static_cast<SampleType>(44100.0)),
-            normalizationCounter(0)
-
+            kernels(simd::getKernels<SampleType>())
     {
-        lfoX = cos(static_cast<SampleType>(0.0));
-        lfoY = sin(static_cast<SampleType>(0.0));
+        for (size_t i = 0; i < numOscillators; ++i)
+        {
+            lfoX[i] = cos(static_cast<SampleType>(0.0));
+            lfoY[i] = sin(static_cast<SampleType>(0.0));
+            lfoE[i] = static_cast<SampleType>(0.0);
+            lfoEControl[i] = static_cast<SampleType>(0.0);
+            rampValue[i] = static_cast<SampleType>(0.0);
+            rampStep[i] = static_cast<SampleType>(0.0);
+            lfoRate[i] = static_cast<SampleType>(1.0);
+        }
     }
 
     void setSampleRate(SampleType rate)
     {
         sampleRate = rate;
-        updateLfo();
+        for (size_t i = 0; i < numOscillators; ++i)
+            updateLfo(i);
     }
 
-    void setRate(SampleType rate)
+    void setRate(size_t index, SampleType rate)
     {
-        lfoRate = rate;
-        updateLfo();
+        lfoRate[index] = rate;
+        updateLfo(index);
     }
 
-    template <typename ProcessContext>
-    void process(const ProcessContext &context) noexcept
+    // At control rate the oscillators only advance every controlInterval samples and
+    // the output ramps linearly in between. A ramp that is under way is always
+    // finished first, so switching rates never makes the output jump.
+    void process(SampleType *const *outputs, size_t numSamples, bool controlRate = false) noexcept
     {
-        auto &outputBlock = context.getOutputBlock();
-        const auto numSamples = outputBlock.getNumSamples();
-
-        auto *outputSamples = outputBlock.getChannelPointer(0);
-        normalize();
+        samplesSinceNormalize += numSamples;
+        if (samplesSinceNormalize >= normalizeInterval)
+        {
+            normalize();
+            samplesSinceNormalize = 0;
+        }
 
-        for (size_t i = 0; i < numSamples; ++i)
+        size_t done = 0;
+        while (done < numSamples)
         {
-            lfoX = lfoX - lfoE * lfoY;
-            lfoY = lfoE * lfoX + lfoY;
-            outputSamples[i] = lfoX;
+            if (rampRemaining > 0)
+            {
+                const size_t count = rampRemaining < numSamples - done ? rampRemaining : numSamples - done;
+                for (size_t i = 0; i < numOscillators; ++i)
+                {
+                    for (size_t j = 0; j < count; ++j)
+                    {
+                        rampValue[i] += rampStep[i];
+                        outputs[i][done + j] = rampValue[i];
+                    }
+                }
+
+                rampRemaining -= count;
+                done += count;
+            }
+            else if (controlRate)
+            {
+                for (size_t i = 0; i < numOscillators; ++i)
+                {
+                    rampValue[i] = lfoX[i];
+                    lfoX[i] = lfoX[i] - lfoEControl[i] * lfoY[i];
+                    lfoY[i] = lfoEControl[i] * lfoX[i] + lfoY[i];
+                    rampStep[i] = (lfoX[i] - rampValue[i]) / static_cast<SampleType>(controlInterval);
+                }
+
+                rampRemaining = controlInterval;
+            }
+            else
+            {
+                SampleType *remaining[numOscillators];
+                for (size_t i = 0; i < numOscillators; ++i)
+                    remaining[i] = outputs[i] + done;
+
+                kernels.generateLfo(lfoX, lfoY, lfoE, remaining, numOscillators, numSamples - done);
+                done = numSamples;
+            }
         }
     }
 };
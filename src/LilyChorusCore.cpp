@@ -0,0 +1,296 @@
+#include "LilyChorusCore.h"
+
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <juce_dsp/juce_dsp.h>
+#include <juce_core/juce_core.h>
+
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+#include "LushChorus.h"
+
+struct lilychorus
+{
+    explicit lilychorus(lilychorus_precision precisionToUse) : precision(precisionToUse) {}
+
+    lilychorus_precision precision;
+    std::unique_ptr<LushChorus<float>> chorusFloat;
+    std::unique_ptr<LushChorus<double>> chorusDouble;
+
+    // Only used to deinterleave, sized in prepare
+    juce::AudioBuffer<float> scratchFloat;
+    juce::AudioBuffer<double> scratchDouble;
+
+    uint32_t maxBlockSize = 0;
+    uint32_t numChannels = 0;
+};
+
+namespace
+{
+    // The high-pass filter and the voice panning are laid out for mono or stereo
+    constexpr uint32_t maxChannels = 2;
+
+    template <typename SampleType>
+    LushChorus<SampleType> *getChorus(lilychorus &instance)
+    {
+        if constexpr (std::is_same_v<SampleType, float>)
+            return instance.chorusFloat.get();
+        else
+            return instance.chorusDouble.get();
+    }
+
+    template <typename SampleType>
+    juce::AudioBuffer<SampleType> &getScratch(lilychorus &instance)
+    {
+        if constexpr (std::is_same_v<SampleType, float>)
+            return instance.scratchFloat;
+        else
+            return instance.scratchDouble;
+    }
+
+    template <typename SampleType>
+    void applyParams(LushChorus<SampleType> &chorus, const lilychorus_params &params)
+    {
+        // Same ranges as the plugin's parameters
+        chorus.setRate(static_cast<SampleType>(juce::jlimit(0.01, 10.0, params.rate)));
+        chorus.setDepth(static_cast<SampleType>(juce::jlimit(0.0, 1.0, params.depth)));
+        chorus.setMix(static_cast<SampleType>(juce::jlimit(0.0, 1.0, params.mix)));
+        chorus.setDelay(static_cast<SampleType>(juce::jlimit(1.0, 50.0, params.delay_ms)));
+        chorus.setSpread(static_cast<SampleType>(juce::jlimit(0.5, 1.0, params.spread)));
+        chorus.setRateSpread(static_cast<SampleType>(juce::jlimit(0.01, 1.0, params.rate_spread)));
+        chorus.setEnableHighPass(params.enable_highpass != 0);
+        chorus.setHighPassCutoff(static_cast<SampleType>(juce::jlimit(50.0, 2000.0, params.highpass_cutoff)));
+        chorus.setFeedbackAmount(static_cast<SampleType>(juce::jlimit(0.0, 1.0, params.feedback)));
+        chorus.setInvertFeedback(params.invert_feedback != 0);
+        chorus.setInvert(params.invert != 0);
+        chorus.setPanLaw(params.pan_law != 0 ? LushChorus<SampleType>::PanLaw::equalPower : LushChorus<SampleType>::PanLaw::linear);
+    }
+
+    template <typename SampleType>
+    lilychorus_status checkProcessArguments(lilychorus *instance, const void *samples, uint32_t numChannels)
+    {
+        if (instance == nullptr || samples == nullptr || numChannels == 0)
+            return LILYCHORUS_ERROR_INVALID_ARGUMENT;
+
+        if (getChorus<SampleType>(*instance) == nullptr)
+            return LILYCHORUS_ERROR_WRONG_PRECISION;
+
+        if (instance->maxBlockSize == 0)
+            return LILYCHORUS_ERROR_NOT_PREPARED;
+
+        if (numChannels > instance->numChannels)
+            return LILYCHORUS_ERROR_TOO_MANY_CHANNELS;
+
+        return LILYCHORUS_OK;
+    }
+
+    template <typename SampleType>
+    lilychorus_status processPlanar(lilychorus *instance, SampleType *const *channels, uint32_t numChannels, uint32_t numFrames)
+    {
+        const auto status = checkProcessArguments<SampleType>(instance, channels, numChannels);
+        if (status != LILYCHORUS_OK)
+            return status;
+
+        auto &chorus = *getChorus<SampleType>(*instance);
+
+        for (uint32_t start = 0; start < numFrames; start += instance->maxBlockSize)
+        {
+            const auto count = juce::jmin(instance->maxBlockSize, numFrames - start);
+            juce::dsp::AudioBlock<SampleType> block(channels, numChannels, start, count);
+            chorus.process(juce::dsp::ProcessContextReplacing<SampleType>(block));
+        }
+
+        return LILYCHORUS_OK;
+    }
+
+    template <typename SampleType>
+    lilychorus_status processInterleaved(lilychorus *instance, SampleType *samples, uint32_t numChannels, uint32_t numFrames)
+    {
+        const auto status = checkProcessArguments<SampleType>(instance, samples, numChannels);
+        if (status != LILYCHORUS_OK)
+            return status;
+
+        auto &chorus = *getChorus<SampleType>(*instance);
+        auto &scratch = getScratch<SampleType>(*instance);
+
+        for (uint32_t start = 0; start < numFrames; start += instance->maxBlockSize)
+        {
+            const auto count = juce::jmin(instance->maxBlockSize, numFrames - start);
+            auto *frames = samples + (size_t)start * numChannels;
+
+            for (uint32_t channel = 0; channel < numChannels; ++channel)
+            {
+                auto *planar = scratch.getWritePointer((int)channel);
+                for (uint32_t i = 0; i < count; ++i)
+                    planar[i] = frames[(size_t)i * numChannels + channel];
+            }
+
+            juce::dsp::AudioBlock<SampleType> block(scratch.getArrayOfWritePointers(), numChannels, 0, count);
+            chorus.process(juce::dsp::ProcessContextReplacing<SampleType>(block));
+
+            for (uint32_t channel = 0; channel < numChannels; ++channel)
+            {
+                const auto *planar = scratch.getReadPointer((int)channel);
+                for (uint32_t i = 0; i < count; ++i)
+                    frames[(size_t)i * numChannels + channel] = planar[i];
+            }
+        }
+
+        return LILYCHORUS_OK;
+    }
+}
+
+extern "C"
+{
+    uint32_t lilychorus_api_version(void)
+    {
+        return LILYCHORUS_API_VERSION;
+    }
+
+    const char *lilychorus_simd_path(void)
+    {
+        return LushChorus<float>::getInstructionSetName();
+    }
+
+    lilychorus *lilychorus_create(lilychorus_precision precision)
+    {
+        if (precision != LILYCHORUS_FLOAT32 && precision != LILYCHORUS_FLOAT64)
+            return nullptr;
+
+        try
+        {
+            auto instance = std::make_unique<lilychorus>(precision);
+
+            if (precision == LILYCHORUS_FLOAT32)
+                instance->chorusFloat = std::make_unique<LushChorus<float>>();
+            else
+                instance->chorusDouble = std::make_unique<LushChorus<double>>();
+
+            return instance.release();
+        }
+        catch (const std::bad_alloc &)
+        {
+            return nullptr;
+        }
+    }
+
+    void lilychorus_destroy(lilychorus *instance)
+    {
+        delete instance;
+    }
+
+    lilychorus_status lilychorus_prepare(lilychorus *instance, double sample_rate, uint32_t max_block_size, uint32_t num_channels, int32_t keep_state)
+    {
+        if (instance == nullptr || sample_rate <= 0.0 || max_block_size == 0 || num_channels == 0)
+            return LILYCHORUS_ERROR_INVALID_ARGUMENT;
+
+        if (num_channels > maxChannels)
+            return LILYCHORUS_ERROR_TOO_MANY_CHANNELS;
+
+        juce::dsp::ProcessSpec spec = {};
+        spec.sampleRate = sample_rate;
+        spec.maximumBlockSize = max_block_size;
+        spec.numChannels = num_channels;
+
+        // A failed prepare leaves the instance running with the block size and channels it had. The
+        // chorus throws before changing anything, and keeping the scratch's contents makes JUCE
+        // allocate the new buffer before letting go of the old one.
+        try
+        {
+            if (instance->chorusFloat != nullptr)
+            {
+                instance->chorusFloat->prepare(spec, num_channels, keep_state != 0);
+                instance->scratchFloat.setSize((int)num_channels, (int)max_block_size, true, false, true);
+            }
+            else
+            {
+                instance->chorusDouble->prepare(spec, num_channels, keep_state != 0);
+                instance->scratchDouble.setSize((int)num_channels, (int)max_block_size, true, false, true);
+            }
+        }
+        catch (const std::bad_alloc &)
+        {
+            return LILYCHORUS_ERROR_OUT_OF_MEMORY;
+        }
+
+        instance->maxBlockSize = max_block_size;
+        instance->numChannels = num_channels;
+        return LILYCHORUS_OK;
+    }
+
+    lilychorus_status lilychorus_reset(lilychorus *instance)
+    {
+        if (instance == nullptr)
+            return LILYCHORUS_ERROR_INVALID_ARGUMENT;
+
+        if (instance->maxBlockSize == 0)
+            return LILYCHORUS_ERROR_NOT_PREPARED;
+
+        if (instance->chorusFloat != nullptr)
+            instance->chorusFloat->reset();
+        else
+            instance->chorusDouble->reset();
+
+        return LILYCHORUS_OK;
+    }
+
+    void lilychorus_default_params(lilychorus_params *params)
+    {
+        if (params == nullptr)
+            return;
+
+        params->struct_size = sizeof(lilychorus_params);
+        params->rate = 6.5;
+        params->rate_spread = 0.95;
+        params->depth = 0.25;
+        params->mix = 0.5;
+        params->delay_ms = 17.0;
+        params->spread = 0.95;
+        params->highpass_cutoff = 150.0;
+        params->feedback = 0.0;
+        params->enable_highpass = 0;
+        params->invert_feedback = 0;
+        params->invert = 0;
+        params->pan_law = 0;
+    }
+
+    lilychorus_status lilychorus_set_params(lilychorus *instance, const lilychorus_params *params)
+    {
+        if (instance == nullptr || params == nullptr || params->struct_size < sizeof(uint32_t))
+            return LILYCHORUS_ERROR_INVALID_ARGUMENT;
+
+        // Callers built against an older header pass a shorter struct
+        lilychorus_params merged;
+        lilychorus_default_params(&merged);
+        std::memcpy(&merged, params, juce::jmin((size_t)params->struct_size, sizeof(lilychorus_params)));
+
+        if (instance->chorusFloat != nullptr)
+            applyParams(*instance->chorusFloat, merged);
+        else
+            applyParams(*instance->chorusDouble, merged);
+
+        return LILYCHORUS_OK;
+    }
+
+    lilychorus_status lilychorus_process_planar_f32(lilychorus *instance, float *const *channels, uint32_t num_channels, uint32_t num_frames)
+    {
+        return processPlanar(instance, channels, num_channels, num_frames);
+    }
+
+    lilychorus_status lilychorus_process_planar_f64(lilychorus *instance, double *const *channels, uint32_t num_channels, uint32_t num_frames)
+    {
+        return processPlanar(instance, channels, num_channels, num_frames);
+    }
+
+    lilychorus_status lilychorus_process_interleaved_f32(lilychorus *instance, float *samples, uint32_t num_channels, uint32_t num_frames)
+    {
+        return processInterleaved(instance, samples, num_channels, num_frames);
+    }
+
+    lilychorus_status lilychorus_process_interleaved_f64(lilychorus *instance, double *samples, uint32_t num_channels, uint32_t num_frames)
+    {
+        return processInterleaved(instance, samples, num_channels, num_frames);
+    }
+}
@@ -2,34 +2,102 @@
 #include "LushChorus.h"
 
 template <typename SampleType>
-LushChorus<SampleType>::LushChorus()
+LushChorus<SampleType>::LushChorus() : kernels(simd::getKernels<SampleType>())
 {
-    dryWet.setMixingRule(juce::dsp::DryWetMixingRule::linear);
+    // Sized for the default layout, so parameters can be set before prepare()
+    gainMatrix.resize(numberOfDelayLines * numOutputChannels);
+    activeVoiceScale.setCurrentAndTargetValue(1);
 }
 
 template <typename SampleType>
 void LushChorus<SampleType>::prepare(const juce::dsp::ProcessSpec &spec)
 {
+    prepare(spec, spec.numChannels, false);
+}
+
+template <typename SampleType>
+void LushChorus<SampleType>::prepare(const juce::dsp::ProcessSpec &spec, size_t numInputChannelsToUse, bool keepState)
+{
+    const auto newNumOutputChannels = juce::jmax((size_t)1, (size_t)spec.numChannels);
+
+    // Only a mono input or one input per output has a matching set of delay histories
+    const auto newNumInputChannels = numInputChannelsToUse == 1 ? (size_t)1 : newNumOutputChannels;
+
+    // Everything runs in fixed size chunks, so the block size doesn't matter. If nothing
+    // else changed, the buffers already there will do.
+    if (isPrepared && spec.sampleRate == sampleRate && newNumOutputChannels == numOutputChannels && newNumInputChannels == numInputChannels)
+    {
+        if (!keepState)
+        {
+            reset();
+        }
+
+        return;
+    }
+
+    const auto maxPossibleDelay = std::ceil((maximumDelayModulation * maxDepth * oscVolumeMultiplier + maxCentreDelayMs) * spec.sampleRate / 1000.0);
+    const auto minPossibleDelay = std::floor(minimumDelayMs * spec.sampleRate / 1000.0);
+
+    // Measure the layout and make room for it before changing anything, so if the memory
+    // can't be had this throws with the chorus still as it was. Going back to a lower
+    // sample rate or fewer channels reuses the block that is already there.
+    const auto ringSize = ChorusDelayLine<SampleType>::getRingSize(static_cast<size_t>(maxPossibleDelay), chunkSize);
+    arena.startMeasuring();
+    takeMemory(ringSize, newNumInputChannels);
+    const bool freshMemory = arena.reserve();
+    arena.startCarving();
+    const auto memory = takeMemory(ringSize, newNumInputChannels);
+
+    isPrepared = true;
     sampleRate = spec.sampleRate;
+    numOutputChannels = newNumOutputChannels;
+    numInputChannels = newNumInputChannels;
 
-    const auto maxPossibleDelay = std::ceil((maximumDelayModulation * maxDepth * oscVolumeMultiplier + maxCentreDelayMs) * sampleRate / 1000.0);
-    dryWet.prepare(spec);
+    std::copy(std::begin(memory.delayTimes), std::end(memory.delayTimes), delayTimeSamples);
+    std::copy(std::begin(memory.taps), std::end(memory.taps), tapSamples);
+    depthSamples = memory.depth;
+    fadeSamples = memory.fade;
 
     for (size_t i = 0; i < numberOfDelayLines; ++i)
     {
-        delay[i] = juce::dsp::DelayLine<SampleType, juce::dsp::DelayLineInterpolationTypes::Lagrange3rd>{static_cast<int>(maxPossibleDelay)};
-        delay[i].prepare(spec);
+        delay[i].prepare(memory.delays[i], static_cast<size_t>(minPossibleDelay), freshMemory);
+    }
 
-        bufferDelayTimes[i].setSize(1, (int)spec.maximumBlockSize, false, false, true);
+    lfo.setSampleRate(static_cast<SampleType>(sampleRate));
 
-        lfo[i].setSampleRate(sampleRate);
-    }
+    gainMatrix.resize(numberOfDelayLines * numOutputChannels);
 
     update();
+    updateGainMatrix();
     reset();
     updateHighPass();
 }
 
+template <typename SampleType>
+typename LushChorus<SampleType>::Memory LushChorus<SampleType>::takeMemory(size_t ringSize, size_t numChannels)
+{
+    Memory memory;
+
+    // Scratch only ever holds one chunk, so the host's maximum block size doesn't matter
+    for (size_t i = 0; i < numberOfDelayLines; ++i)
+    {
+        memory.delayTimes[i] = arena.take<SampleType>(chunkSize);
+        memory.taps[i] = arena.take<SampleType>(chunkSize);
+    }
+
+    memory.depth = arena.take<SampleType>(chunkSize);
+    memory.fade = arena.take<SampleType>(chunkSize);
+
+    // Each channel of each voice starts at its own offset within a page, so reading
+    // every voice at the same delay doesn't land all of them in the same cache sets
+    for (size_t i = 0; i < numberOfDelayLines; ++i)
+    {
+        memory.delays[i] = ChorusDelayLine<SampleType>::take(arena, numChannels, ringSize, 1 + i * numChannels);
+    }
+
+    return memory;
+}
+
 template <typename SampleType>
 void LushChorus<SampleType>::reset()
 {
@@ -39,9 +107,18 @@ void LushChorus<SampleType>::reset()
     }
 
     oscVolume.reset(sampleRate, 0.05);
-    highPassFilterL.reset();
-    highPassFilterR.reset();
-    dryWet.reset();
+    mixAmount.reset(sampleRate, 0.05);
+    activeVoiceScale.reset(sampleRate, 0.05);
+
+    for (auto &gain : gainMatrix)
+    {
+        gain.reset(sampleRate, 0.05);
+    }
+
+    for (auto &state : highPassState)
+    {
+        state[0] = state[1] = 0;
+    }
 }
 
 template <typename SampleType>
@@ -49,19 +126,55 @@ void LushChorus<SampleType>::update()
 {
     for (size_t i = 0; i < numberOfDelayLines; ++i)
     {
-        lfo[i].setRate(static_cast<SampleType>(rate / (1.0f + rateSpread * i)));
+        lfo.setRate(i, static_cast<SampleType>(rate / (1.0f + rateSpread * i)));
     }
 
     oscVolume.setTargetValue(depth * oscVolumeMultiplier);
-    dryWet.setWetMixProportion(mix);
+    mixAmount.setTargetValue(mix);
 }
 
 template <typename SampleType>
 void LushChorus<SampleType>::updateHighPass()
 {
+    // Normalised by a0 the same way juce::dsp::IIR::Coefficients does
     double qFactor = 0.7071;
-    highPassFilterL.coefficients = juce::dsp::IIR::Coefficients<SampleType>::makeHighPass(sampleRate, highPassCutoff, qFactor);
-    highPassFilterR.coefficients = juce::dsp::IIR::Coefficients<SampleType>::makeHighPass(sampleRate, highPassCutoff, qFactor);
+    const auto coefficients = juce::dsp::IIR::ArrayCoefficients<SampleType>::makeHighPass(sampleRate, highPassCutoff, static_cast<SampleType>(qFactor));
+    const auto a0 = coefficients[3];
+    highPassCoefficients[0] = coefficients[0] / a0;
+    highPassCoefficients[1] = coefficients[1] / a0;
+    highPassCoefficients[2] = coefficients[2] / a0;
+    highPassCoefficients[3] = coefficients[4] / a0;
+    highPassCoefficients[4] = coefficients[5] / a0;
+}
+
+template <typename SampleType>
+void LushChorus<SampleType>::updateGainMatrix()
+{
+    // At the lowest quality only the first half of the voices play, made up to the same level.
+    // The first voices alternate between channels, so the stereo picture survives.
+    const size_t activeVoices = qualityLevel >= qualityHalfVoices ? numberOfDelayLines / 2 : numberOfDelayLines;
+    const auto scale = static_cast<SampleType>(numberOfDelayLines) / static_cast<SampleType>(activeVoices);
+
+    // Ramps along with the gains, so feedback taken from them stays level as voices drop out
+    activeVoiceScale.setTargetValue(scale);
+
+    for (size_t voice = 0; voice < numberOfDelayLines; ++voice)
+    {
+        for (size_t channel = 0; channel < numOutputChannels; ++channel)
+        {
+            const bool favoured = voice % numOutputChannels == channel;
+            SampleType gain = favoured ? spread : 1 - spread;
+
+            if (panLaw == PanLaw::equalPower)
+            {
+                gain = std::sqrt(gain);
+            }
+
+            gain = voice < activeVoices ? gain * scale : static_cast<SampleType>(0);
+
+            gainMatrix[voice * numOutputChannels + channel].setTargetValue(gain);
+        }
+    }
 }
 
 template <typename SampleType>
@@ -103,7 +216,11 @@ void LushChorus<SampleType>::setDelay(SampleType delay)
 template <typename SampleType>
 void LushChorus<SampleType>::setSpread(SampleType spread)
 {
-    this->spread = spread;
+    if (spread != this->spread)
+    {
+        this->spread = spread;
+        updateGainMatrix();
+    }
 }
 
 template <typename SampleType>
@@ -164,5 +281,38 @@ void LushChorus<SampleType>::setInvert(bool invert)
     }
 }
 
+template <typename SampleType>
+void LushChorus<SampleType>::setPanLaw(PanLaw law)
+{
+    if (law != panLaw)
+    {
+        panLaw = law;
+        updateGainMatrix();
+    }
+}
+
+template <typename SampleType>
+void LushChorus<SampleType>::setQualityLevel(int level)
+{
+    level = juce::jlimit(0, (int)numQualityLevels - 1, level);
+    if (level == qualityLevel)
+    {
+        return;
+    }
+
+    const bool wasLinear = qualityLevel >= qualityLinearInterpolation;
+    qualityLevel = level;
+
+    // Switching interpolation crossfades between the two over the next chunk
+    fadeInterpolation = wasLinear != (qualityLevel >= qualityLinearInterpolation);
+    updateGainMatrix();
+}
+
+template <typename SampleType>
+const char *LushChorus<SampleType>::getInstructionSetName()
+{
+    return simd::getIsaName(simd::getActiveIsa());
+}
+
 template class LushChorus<float>;
 template class LushChorus<double>;
@@ -4,7 +4,15 @@
 #include <juce_dsp/juce_dsp.h>
 #include <juce_core/juce_core.h>
 
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <vector>
+
+#include "ChorusDelayLine.h"
+#include "InstanceArena.h"
 #include "Lfo.h"
+#include "SimdDispatch.h"
 
 // https://www.soundonsound.com/techniques/more-creative-synthesis-delays
 
@@ -13,7 +21,19 @@ class LushChorus
 {
 public:
     LushChorus();
+
+    // Starts from silence, with one input per output
     void prepare(const juce::dsp::ProcessSpec &spec);
+
+    // For a mono input feeding spec.numChannels outputs, pass numInputChannels = 1:
+    // the delay lines then keep a single history, and the dry signal is read from
+    // the first input channel for every output. Any other count is taken as one input
+    // per output, with the caller clearing inputs it doesn't have.
+    //
+    // With keepState, re-preparing at the same sample rate and channels carries on
+    // from where the voices were, without a click, and allocates nothing. Otherwise,
+    // or if anything changed, the chorus starts from silence.
+    void prepare(const juce::dsp::ProcessSpec &spec, size_t numInputChannels, bool keepState = false);
     void reset();
 
     template <typename ProcessContext>
@@ -21,102 +41,301 @@ public:
     {
         const auto &inputBlock = context.getInputBlock();
         auto &outputBlock = context.getOutputBlock();
-        const auto numChannels = outputBlock.getNumChannels();
         const auto numSamples = outputBlock.getNumSamples();
-        if (context.isBypassed)
+
+        // Until a prepare has got its memory there is nothing to render with
+        if (context.isBypassed || !isPrepared)
+        {
+            if (numInputChannels == 1 && outputBlock.getNumChannels() > 1)
+            {
+                // A mono input is heard on every output, as it is when the chorus runs
+                const auto *drySamples = inputBlock.getChannelPointer(0);
+
+                for (size_t channel = 0; channel < outputBlock.getNumChannels(); ++channel)
+                {
+                    auto *outputSamples = outputBlock.getChannelPointer(channel);
+
+                    if (outputSamples != drySamples)
+                    {
+                        std::copy(drySamples, drySamples + numSamples, outputSamples);
+                    }
+                }
+            }
+            else
+            {
+                outputBlock.copyFrom(inputBlock);
+            }
+
+            return;
+        }
+
+        if (numSamples == 0 || outputBlock.getNumChannels() == 0)
         {
-            outputBlock.copyFrom(inputBlock);
             return;
         }
 
-        SampleType *delaySamples[numberOfDelayLines];
+        // Decaying feedback and filter tails would otherwise run into denormals, which are
+        // very slow on most CPUs, whenever the caller hasn't turned them off itself
+        juce::ScopedNoDenormals noDenormals;
+
+        // Work through the host's block in fixed chunks, so the scratch buffers stay
+        // small enough to live in L1 whatever block size the host picks
+        const juce::dsp::AudioBlock<const SampleType> dryBlock(inputBlock);
+        for (size_t offset = 0; offset < numSamples; offset += chunkSize)
+        {
+            processChunk(dryBlock, outputBlock, offset, juce::jmin(chunkSize, numSamples - offset));
+        }
+    }
+
+    // Name of the instruction set the DSP kernels were dispatched to, e.g. "avx2"
+    static const char *getInstructionSetName();
+
+    void setRate(SampleType rate);
+    void setDepth(SampleType depth);
+    void setMix(SampleType mix);
+    void setDelay(SampleType delay);
+    void setSpread(SampleType spread);
+    void setRateSpread(SampleType spread);
+    void setEnableHighPass(bool enable);
+    void setHighPassCutoff(SampleType cutoff);
+    void setFeedbackAmount(SampleType feedback);
+    void setInvertFeedback(bool invert);
+    void setInvert(bool invert);
+
+    enum class PanLaw
+    {
+        linear,    // favoured channel gets spread, the others 1 - spread
+        equalPower // same split, but constant power rather than constant amplitude
+    };
+
+    void setPanLaw(PanLaw law);
+
+    // Cheaper ways of running, for when the machine is struggling. Each level
+    // keeps the savings of the ones before it. Changes are crossfaded.
+    enum QualityLevel
+    {
+        qualityFull = 0,
+        qualityLinearInterpolation,
+        qualityControlRateModulation,
+        qualityHalfVoices,
+        numQualityLevels
+    };
+
+    void setQualityLevel(int level);
+    int getQualityLevel() const noexcept { return qualityLevel; }
+
+private:
+    // Samples processed per pass, whatever the host's block size
+    static constexpr size_t chunkSize = 64;
+
+    void processChunk(const juce::dsp::AudioBlock<const SampleType> &dryBlock, const juce::dsp::AudioBlock<SampleType> &outputBlock, size_t offset, size_t numSamples) noexcept
+    {
+        const auto numChannels = outputBlock.getNumChannels();
+
+        for (size_t i = 0; i < numSamples; ++i)
+        {
+            depthSamples[i] = oscVolume.getNextValue();
+        }
+
+        lfo.process(delayTimeSamples, numSamples, qualityLevel >= qualityControlRateModulation);
 
         for (size_t i = 0; i < numberOfDelayLines; ++i)
         {
-            auto delayValuesBlock = juce::dsp::AudioBlock<SampleType>(bufferDelayTimes[i]).getSubBlock(0, numSamples);
-            auto contextDelay = juce::dsp::ProcessContextReplacing<SampleType>(delayValuesBlock);
-            delayValuesBlock.clear();
+            kernels.computeDelayTimes(delayTimeSamples[i], depthSamples, maximumDelayModulation, centreDelay,
+                                      minimumDelayMs, static_cast<SampleType>(sampleRate / 1000.0), numSamples);
+        }
 
-            lfo[i].process(contextDelay);
-            delayValuesBlock.multiplyBy(oscVolume);
+        // Pick the specialisation for this chunk's settings once, so none of
+        // them need checking inside the voice loops
+        const size_t variant = (feedbackAmount != 0 ? variantFeedback : 0) |
+                               (enableHighPass ? variantHighPass : 0) |
+                               (invertFactor < 0 ? variantInvert : 0) |
+                               (numChannels > 1 ? variantStereo : 0) |
+                               (numChannels > 1 && numInputChannels == 1 ? variantMonoInput : 0);
+        const size_t numRendered = (this->*getWetRenderer(variant))(dryBlock, outputBlock, offset, delayTimeSamples, numSamples);
+        fadeInterpolation = false;
+        activeVoiceScale.skip((int)numSamples);
 
-            delaySamples[i] = bufferDelayTimes[i].getWritePointer(0);
+        // Channels beyond the ones the chorus was prepared for pass straight through
+        for (size_t channel = numRendered; channel < numChannels; ++channel)
+        {
+            const auto *drySamples = dryBlock.getChannelPointer(channel) + offset;
+            auto *outputSamples = outputBlock.getChannelPointer(channel) + offset;
 
-            for (size_t j = 0; j < numSamples; ++j)
+            if (outputSamples != drySamples)
             {
-                auto lfo = juce::jmax(static_cast<SampleType>(1.0), maximumDelayModulation * delaySamples[i][j] + centreDelay);
-                delaySamples[i][j] = static_cast<SampleType>(lfo * sampleRate / 1000.0);
+                std::copy(drySamples, drySamples + numSamples, outputSamples);
             }
         }
+    }
 
-        dryWet.pushDrySamples(inputBlock);
+    // Renders, filters and mixes the chunk into the output, returning how many channels it covered
+    using WetRenderer = size_t (LushChorus::*)(const juce::dsp::AudioBlock<const SampleType> &, const juce::dsp::AudioBlock<SampleType> &,
+                                               size_t, SampleType *const *, size_t) noexcept;
+
+    static constexpr size_t variantFeedback = 1,
+                            variantHighPass = 2,
+                            variantInvert = 4,
+                            variantStereo = 8,
+                            variantMonoInput = 16,
+                            numVariants = 32;
+
+    template <bool hasFeedback, bool highPass, bool invert, bool stereo, bool monoInput>
+    size_t renderWet(const juce::dsp::AudioBlock<const SampleType> &dryBlock, const juce::dsp::AudioBlock<SampleType> &outputBlock,
+                     size_t offset, SampleType *const *delaySamples, size_t numSamples) noexcept
+    {
+        const size_t numChannels = stereo ? juce::jmin(outputBlock.getNumChannels(), numOutputChannels) : 1;
 
-        for (size_t channel = 0; channel < numChannels; ++channel)
+        constexpr SampleType normalisation = static_cast<SampleType>(1.0 / (numberOfDelayLines * 0.5));
+        constexpr SampleType outputGain = invert ? -normalisation : normalisation;
+        const SampleType feedbackGain = hasFeedback ? feedbackAmount * feedbackInvertFactor : static_cast<SampleType>(0);
+        const SampleType rampScale = static_cast<SampleType>(1) / static_cast<SampleType>(numSamples);
+
+        const bool linear = qualityLevel >= qualityLinearInterpolation;
+        const auto read = linear ? kernels.interpolateTapsLinear : kernels.interpolateTaps;
+        const auto fadeFrom = fadeInterpolation ? (linear ? kernels.interpolateTaps : kernels.interpolateTapsLinear) : nullptr;
+
+        // The mix ramp is shared by every channel
+        const SampleType wetGain = mixAmount.getCurrentValue();
+        const SampleType wetStep = (mixAmount.skip((int)numSamples) - wetGain) * rampScale;
+
+        // A mono input keeps one history per voice and pans its taps into every output channel
+        const size_t numHistories = monoInput ? 1 : numChannels;
+
+        for (size_t history = 0; history < numHistories; ++history)
         {
-            auto *inputSamples = inputBlock.getChannelPointer(channel);
-            auto *outputSamples = outputBlock.getChannelPointer(channel);
+            // In place, the dry signal is the output: the voices read it before anything is written back
+            const auto *drySamples = dryBlock.getChannelPointer(history) + offset;
+            bool voiceActive[numberOfDelayLines];
 
-            for (size_t i = 0; i < numSamples; ++i)
+            for (size_t j = 0; j < numberOfDelayLines; ++j)
             {
-                SampleType wet = 0.0;
+                voiceActive[j] = false;
+                for (size_t channel = monoInput ? 0 : history; channel < (monoInput ? numChannels : history + 1); ++channel)
+                {
+                    const auto &voiceGain = gainMatrix[j * numOutputChannels + channel];
+                    voiceActive[j] = voiceActive[j] || voiceGain.isSmoothing() || voiceGain.getTargetValue() != 0;
+                }
+
+                if (!voiceActive[j])
+                {
+                    // Silent voices only keep their history current, so they can fade back in cleanly
+                    delay[j].write(kernels, history, drySamples, numSamples);
+                    continue;
+                }
+
+                // Feedback follows the voice's gain on its own side, and leaves out the
+                // boost that makes up for switched off voices
+                const size_t feedbackChannel = monoInput ? j % numChannels : history;
+                const auto voiceScale = activeVoiceScale.getCurrentValue();
+                const auto feedbackStart = gainMatrix[j * numOutputChannels + feedbackChannel].getCurrentValue();
+                delay[j].template process<hasFeedback>(kernels, history, drySamples, delaySamples[j], tapSamples[j], numSamples,
+                                                       feedbackStart * feedbackGain / voiceScale, read, fadeFrom, fadeSamples);
+            }
+
+            // Mono input mixes into the last channel first, so channel 0, which holds the dry
+            // signal when processing in place, is the last to be overwritten
+            for (size_t i = 0; i < (monoInput ? numChannels : 1); ++i)
+            {
+                const size_t channel = monoInput ? numChannels - 1 - i : history;
+                auto *outputSamples = outputBlock.getChannelPointer(channel) + offset;
+
+                const SampleType *activeTaps[numberOfDelayLines];
+                SampleType gains[numberOfDelayLines], gainSteps[numberOfDelayLines];
+                size_t numActive = 0;
+
                 for (size_t j = 0; j < numberOfDelayLines; ++j)
                 {
-                    size_t favouredChannel = j % numChannels;
-                    SampleType multiplier = 1.0 * (1.0 - spread);
-                    if (favouredChannel == channel)
+                    if (!voiceActive[j])
                     {
-                        multiplier = 1.0 * spread;
+                        continue;
                     }
 
-                    SampleType delayedSample = delay[j].popSample((int)channel) * multiplier;
-                    SampleType feedbackSample = delayedSample * feedbackAmount * feedbackInvertFactor;
-
-                    delay[j].pushSample((int)channel, inputSamples[i] + feedbackSample);
-                    delay[j].setDelay(delaySamples[j][i]);
-                    wet += delayedSample;
+                    auto &voiceGain = gainMatrix[j * numOutputChannels + channel];
+                    const auto start = voiceGain.getCurrentValue();
+                    const auto end = voiceGain.skip((int)numSamples);
+                    gains[numActive] = start * outputGain;
+                    gainSteps[numActive] = (end - start) * rampScale * outputGain;
+                    activeTaps[numActive] = tapSamples[j];
+                    ++numActive;
                 }
 
-                outputSamples[i] = wet / (numberOfDelayLines * 0.5) * invertFactor;
+                const bool filtered = highPass && channel < numHighPassChannels;
+                kernels.mixVoices(outputSamples, drySamples, activeTaps, gains, gainSteps, numActive, wetGain, wetStep, 1 - wetGain, -wetStep,
+                                  filtered ? highPassCoefficients : nullptr, filtered ? highPassState[channel] : nullptr, numSamples);
             }
         }
 
-        if (enableHighPass)
-        {
-            auto l = outputBlock.getSingleChannelBlock(0);
-            auto r = outputBlock.getSingleChannelBlock(1);
-            highPassFilterL.process(juce::dsp::ProcessContextReplacing<SampleType>(l));
-            highPassFilterR.process(juce::dsp::ProcessContextReplacing<SampleType>(r));
-        }
+        return numChannels;
+    }
 
-        dryWet.mixWetSamples(outputBlock);
+    template <size_t... variants>
+    static constexpr std::array<WetRenderer, sizeof...(variants)> makeWetRenderers(std::index_sequence<variants...>)
+    {
+        return {&LushChorus::renderWet<(variants & variantFeedback) != 0,
+                                       (variants & variantHighPass) != 0,
+                                       (variants & variantInvert) != 0,
+                                       (variants & variantStereo) != 0,
+                                       (variants & variantMonoInput) != 0>...};
     }
 
-    void setRate(SampleType rate);
-    void setDepth(SampleType depth);
-    void setMix(SampleType mix);
-    void setDelay(SampleType delay);
-    void setSpread(SampleType spread);
-    void setRateSpread(SampleType spread);
-    void setEnableHighPass(bool enable);
-    void setHighPassCutoff(SampleType cutoff);
-    void setFeedbackAmount(SampleType feedback);
-    void setInvertFeedback(bool invert);
-    void setInvert(bool invert);
+    static WetRenderer getWetRenderer(size_t variant) noexcept
+    {
+        static constexpr auto renderers = makeWetRenderers(std::make_index_sequence<numVariants>());
+        return renderers[variant];
+    }
 
-private:
     void update();
     void updateHighPass();
+    void updateGainMatrix();
     double sampleRate = 44100.0;
+    bool isPrepared = false;
 
     static const size_t numberOfDelayLines = 4;
 
-    Lfo<SampleType> lfo[numberOfDelayLines];
-    juce::dsp::DelayLine<SampleType, juce::dsp::DelayLineInterpolationTypes::Lagrange3rd> delay[numberOfDelayLines];
+    const simd::Kernels<SampleType> &kernels;
+
+    Lfo<SampleType, numberOfDelayLines> lfo;
+    ChorusDelayLine<SampleType> delay[numberOfDelayLines];
     juce::SmoothedValue<SampleType, juce::ValueSmoothingTypes::Linear> oscVolume;
-    juce::AudioBuffer<SampleType> bufferDelayTimes[numberOfDelayLines];
-    juce::dsp::IIR::Filter<SampleType> highPassFilterL;
-    juce::dsp::IIR::Filter<SampleType> highPassFilterR;
-    juce::dsp::DryWetMixer<SampleType> dryWet;
+    juce::SmoothedValue<SampleType, juce::ValueSmoothingTypes::Linear> mixAmount;
+
+    // Where everything lives in the arena. Nulls while the arena is only measuring.
+    struct Memory
+    {
+        SampleType *delayTimes[numberOfDelayLines] = {};
+        SampleType *taps[numberOfDelayLines] = {};
+        SampleType *depth = nullptr;
+        SampleType *fade = nullptr;
+        typename ChorusDelayLine<SampleType>::Memory delays[numberOfDelayLines];
+    };
+
+    // Takes a layout's worth of memory from the arena, without touching any state
+    Memory takeMemory(size_t ringSize, size_t numChannels);
+
+    // The delay rings and per chunk scratch below all live in this one block
+    InstanceArena arena;
+
+    SampleType *delayTimeSamples[numberOfDelayLines] = {};
+    SampleType *tapSamples[numberOfDelayLines] = {};
+    SampleType *depthSamples = nullptr;
+    SampleType *fadeSamples = nullptr;
+
+    // Voice to output channel gains, voice major, smoothed towards the target
+    // whenever spread, pan law or channel layout change
+    std::vector<juce::SmoothedValue<SampleType, juce::ValueSmoothingTypes::Linear>> gainMatrix;
+    size_t numOutputChannels = 2;
+    size_t numInputChannels = 2;
+    PanLaw panLaw = PanLaw::linear;
+
+    int qualityLevel = qualityFull;
+    bool fadeInterpolation = false;
+    juce::SmoothedValue<SampleType, juce::ValueSmoothingTypes::Linear> activeVoiceScale;
+
+    // Biquad coefficients (b0 b1 b2 a1 a2) and per channel state, run inside mixVoices
+    static constexpr size_t numHighPassChannels = 2;
+    SampleType highPassCoefficients[5] = {};
+    SampleType highPassState[numHighPassChannels][2] = {};
 
     SampleType rate = 6.5, depth = 0.25, mix = 0.5,
                centreDelay = 17.0, spread = 0.95, rateSpread = 0.95, highPassCutoff = 150.0f, feedbackAmount = 0.0f, invertFactor = 1.0f, feedbackInvertFactor = 1.0f;
@@ -126,5 +345,6 @@ private:
     static constexpr SampleType maxDepth = 1.0,
                                 maxCentreDelayMs = 100.0,
                                 oscVolumeMultiplier = 0.2,
-                                maximumDelayModulation = 20.0;
+                                maximumDelayModulation = 20.0,
+                                minimumDelayMs = 1.0;
 };
@@ -23,8 +23,16 @@ ChorusAudioProcessorEditor::ChorusAudioProcessorEditor(ChorusAudioProcessor &p)
 
     setResizable(true, p.wrapperType != juce::AudioProcessor::wrapperType_AudioUnit);
 
-    lastUIWidth.referTo(p.state.state.getChildWithName("uiState").getPropertyAsValue("width", nullptr));
-    lastUIHeight.referTo(p.state.state.getChildWithName("uiState").getPropertyAsValue("height", nullptr));
+    // The processor leaves the UI's sub-tree to the first editor, unless a saved state brought one
+    auto uiState = p.state.state.getChildWithName("uiState");
+    if (!uiState.isValid())
+    {
+        uiState = ValueTree("uiState", {{"width", 400}, {"height", 200}});
+        p.state.state.addChild(uiState, -1, nullptr);
+    }
+
+    lastUIWidth.referTo(uiState.getPropertyAsValue("width", nullptr));
+    lastUIHeight.referTo(uiState.getPropertyAsValue("height", nullptr));
 
     // set our component's initial size to be the last one that was stored in the filter's settings
     setSize(lastUIWidth.getValue(), lastUIHeight.getValue());
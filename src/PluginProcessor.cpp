@@ -36,18 +36,6 @@ inline std::unique_ptr<AudioParameterFloat> buildParam(
         nullptr);
 }
 
-float getParameterValue(AudioProcessorValueTreeState &state, const String &paramID)
-{
-    auto &param = *state.getParameter(paramID);
-    auto range = state.getParameterRange(paramID);
-    return range.convertFrom0to1(param.getValue());
-}
-
-bool getBoolParamValue(AudioProcessorValueTreeState &state, const String &paramID)
-{
-    return state.getParameter(paramID)->getValue() > 0.5f;
-}
-
 ChorusAudioProcessor::ChorusAudioProcessor()
     : AudioProcessor(
           BusesProperties()
@@ -65,49 +53,72 @@ ChorusAudioProcessor::ChorusAudioProcessor()
            std::make_unique<AudioParameterFloat>("highpass_cutoff", "Highpass Cutoff", NormalisableRange<float>(50.0f, 2000.0f, 1.0f, 0.5f), 150.0f),
            buildParam("feedback", "Feedback", 0.0f, 1.0f, 0.0f, 0.01f, "%", float_to_percent_label),
            std::make_unique<AudioParameterBool>("invert_feedback", "Invert Feedback", false),
-           std::make_unique<AudioParameterBool>("invert", "Invert Chorus", false)})
+           std::make_unique<AudioParameterBool>("invert", "Invert Chorus", false),
+           std::make_unique<AudioParameterChoice>("pan_law", "Pan Law", StringArray{"Linear", "Equal Power"}, 0),
+           std::make_unique<AudioParameterBool>("adaptive_quality", "Adaptive Quality", false)})
 {
-    // Add a sub-tree to store the state of our UI
-    state.state.addChild({"uiState", {{"width", 400}, {"height", 200}}, {}}, -1, nullptr);
+    // Hosts construct every plugin when they scan, then only ask for its name, buses and
+    // parameters. So construction stops at the parameter tree: the parameters are looked
+    // up and listened to on the first prepareToPlay, and the editor adds its uiState
+    // sub-tree when it is first opened.
+}
 
-    for (int i = 0; i < state.state.getNumChildren(); ++i)
+void ChorusAudioProcessor::attachToParameters()
+{
+    for (auto *parameter : getParameters())
     {
-        ValueTree paramTree = state.state.getChild(i);
-        String paramId = paramTree.getProperty("id").toString();
-        state.addParameterListener(paramId, this);
+        if (auto *parameterWithId = dynamic_cast<AudioProcessorParameterWithID *>(parameter))
+            state.addParameterListener(parameterWithId->paramID, this);
     }
+
+    rateParam = state.getRawParameterValue("rate");
+    rateSpreadParam = state.getRawParameterValue("rate_spread");
+    depthParam = state.getRawParameterValue("depth");
+    mixParam = state.getRawParameterValue("mix");
+    delayParam = state.getRawParameterValue("delay");
+    spreadParam = state.getRawParameterValue("spread");
+    enableHighPassParam = state.getRawParameterValue("enable_highpass");
+    highPassCutoffParam = state.getRawParameterValue("highpass_cutoff");
+    feedbackParam = state.getRawParameterValue("feedback");
+    invertFeedbackParam = state.getRawParameterValue("invert_feedback");
+    invertParam = state.getRawParameterValue("invert");
+    panLawParam = state.getRawParameterValue("pan_law");
+    adaptiveQualityParam = state.getRawParameterValue("adaptive_quality");
 }
 
 void ChorusAudioProcessor::parameterChanged(const String &parameterID, float newValue)
 {
     ignoreUnused(parameterID);
     ignoreUnused(newValue);
-    updateParams();
+    parametersChanged = true;
 }
 
 void ChorusAudioProcessor::updateParams()
 {
     auto &chorus = processorChain.get<chorusIndex>();
-    chorus.setRate(getParameterValue(state, "rate"));
-    chorus.setDepth(getParameterValue(state, "depth"));
-    chorus.setMix(getParameterValue(state, "mix"));
-    chorus.setDelay(getParameterValue(state, "delay"));
-    chorus.setSpread(getParameterValue(state, "spread"));
-    chorus.setRateSpread(getParameterValue(state, "rate_spread"));
-    chorus.setEnableHighPass(getBoolParamValue(state, "enable_highpass"));
-    chorus.setHighPassCutoff(getParameterValue(state, "highpass_cutoff"));
-    chorus.setFeedbackAmount(getParameterValue(state, "feedback"));
-    chorus.setInvertFeedback(getBoolParamValue(state, "invert_feedback"));
-    chorus.setInvert(getBoolParamValue(state, "invert"));
+    chorus.setRate(rateParam->load());
+    chorus.setDepth(depthParam->load());
+    chorus.setMix(mixParam->load());
+    chorus.setDelay(delayParam->load());
+    chorus.setSpread(spreadParam->load());
+    chorus.setRateSpread(rateSpreadParam->load());
+    chorus.setEnableHighPass(enableHighPassParam->load() > 0.5f);
+    chorus.setHighPassCutoff(highPassCutoffParam->load());
+    chorus.setFeedbackAmount(feedbackParam->load());
+    chorus.setInvertFeedback(invertFeedbackParam->load() > 0.5f);
+    chorus.setInvert(invertParam->load() > 0.5f);
+    chorus.setPanLaw(panLawParam->load() > 0.5f ? LushChorus<float>::PanLaw::equalPower : LushChorus<float>::PanLaw::linear);
 }
 
 ChorusAudioProcessor::~ChorusAudioProcessor()
 {
-    for (int i = 0; i < state.state.getNumChildren(); ++i)
+    if (rateParam == nullptr)
+        return;
+
+    for (auto *parameter : getParameters())
     {
-        ValueTree paramTree = state.state.getChild(i);
-        String paramId = paramTree.getProperty("id").toString();
-        state.removeParameterListener(paramId, this);
+        if (auto *parameterWithId = dynamic_cast<AudioProcessorParameterWithID *>(parameter))
+            state.removeParameterListener(parameterWithId->paramID, this);
     }
 }
 
@@ -179,13 +190,35 @@ void ChorusAudioProcessor::changeProgramName(int index, const String &newName)
 //==============================================================================
 void ChorusAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
+    // Logged here rather than on construction, so plugin scans stay quiet
+    static const bool loggedInstructionSet = []
+    {
+        Logger::writeToLog("LilyChorus DSP kernels: " + String(LushChorus<float>::getInstructionSetName()));
+        return true;
+    }();
+    ignoreUnused(loggedInstructionSet);
+
     dsp::ProcessSpec spec = {};
     spec.sampleRate = sampleRate;
     spec.maximumBlockSize = samplesPerBlock;
-    spec.numChannels = getTotalNumInputChannels();
+    spec.numChannels = getTotalNumOutputChannels();
 
-    processorChain.prepare(spec);
+    if (rateParam == nullptr)
+        attachToParameters();
+
+    parametersChanged = false;
     updateParams();
+
+    // Prepared directly rather than through the chain, so a mono input keeps a single delay history.
+    // Live, a re-prepare that changes nothing (hosts send them on buffer size changes and transport
+    // restarts) keeps the voices running so nothing clicks. Offline renders start from silence,
+    // so a bounce never begins with the tail of whatever played before it.
+    processorChain.get<chorusIndex>().prepare(spec, (size_t)getTotalNumInputChannels(), !isNonRealtime());
+    adaptiveQuality.prepare(sampleRate);
+
+    // Preparing starts the load watcher over at full quality, so the chorus has to follow
+    // it: a re-prepare keeps the chorus running and would otherwise keep it degraded
+    processorChain.get<chorusIndex>().setQualityLevel(adaptiveQuality.getLevel());
 }
 
 void ChorusAudioProcessor::releaseResources()
@@ -194,6 +227,12 @@ void ChorusAudioProcessor::releaseResources()
     // spare memory, etc.
 }
 
+void ChorusAudioProcessor::reset()
+{
+    // A live re-prepare keeps the voices running, hosts call this when they want silence
+    processorChain.reset();
+}
+
 #ifndef JucePlugin_PreferredChannelConfigurations
 bool ChorusAudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts) const
 {
@@ -208,9 +247,11 @@ bool ChorusAudioProcessor::isBusesLayoutSupported(const BusesLayout &layouts) co
     if (layouts.getMainOutputChannelSet() != AudioChannelSet::mono() && layouts.getMainOutputChannelSet() != AudioChannelSet::stereo())
         return false;
 
-        // This checks if the input layout matches the output layout
+        // This checks if the input layout matches the output layout,
+        // apart from mono in to stereo out, which the chorus handles natively
 #if !JucePlugin_IsSynth
-    if (layouts.getMainOutputChannelSet() != layouts.getMainInputChannelSet())
+    const bool monoToStereo = layouts.getMainInputChannelSet() == AudioChannelSet::mono() && layouts.getMainOutputChannelSet() == AudioChannelSet::stereo();
+    if (layouts.getMainOutputChannelSet() != layouts.getMainInputChannelSet() && !monoToStereo)
         return false;
 #endif
 
@@ -229,8 +270,47 @@ void ChorusAudioProcessor::processBlock(AudioBuffer<float> &buffer, MidiBuffer &
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear(i, 0, buffer.getNumSamples());
 
+    const auto startTicks = Time::getHighResolutionTicks();
+
+    if (parametersChanged.exchange(false))
+        updateParams();
+
     dsp::AudioBlock<float> block{buffer};
     processorChain.process(dsp::ProcessContextReplacing<float>(block));
+
+    // Trade quality for time when this block came close to its real-time budget
+    auto &chorus = processorChain.get<chorusIndex>();
+    if (adaptiveQualityParam->load() > 0.5f)
+    {
+        const auto secondsTaken = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - startTicks);
+        chorus.setQualityLevel(adaptiveQuality.update(secondsTaken, buffer.getNumSamples()));
+    }
+    else if (chorus.getQualityLevel() != 0)
+    {
+        adaptiveQuality.reset();
+        chorus.setQualityLevel(0);
+    }
+}
+
+void ChorusAudioProcessor::processBlockBypassed(AudioBuffer<float> &buffer, MidiBuffer &midiMessages)
+{
+    ignoreUnused(midiMessages);
+    auto totalNumInputChannels = getTotalNumInputChannels();
+    auto totalNumOutputChannels = getTotalNumOutputChannels();
+
+    // A mono input plays on both sides when bypassed, as it does through the chorus
+    for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
+    {
+        if (totalNumInputChannels == 1)
+            buffer.copyFrom(i, 0, buffer, 0, 0, buffer.getNumSamples());
+        else
+            buffer.clear(i, 0, buffer.getNumSamples());
+    }
+}
+
+int ChorusAudioProcessor::getQualityLevel() const noexcept
+{
+    return processorChain.get<chorusIndex>().getQualityLevel();
 }
 
 //==============================================================================
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <juce_audio_processors/juce_audio_processors.h>
+#include "AdaptiveQuality.h"
 #include "LushChorus.h"
 
 using namespace juce;
@@ -19,12 +20,17 @@ public:
     void updateParams();
     void prepareToPlay(double sampleRate, int samplesPerBlock) override;
     void releaseResources() override;
+    void reset() override;
 
 #ifndef JucePlugin_PreferredChannelConfigurations
     bool isBusesLayoutSupported(const BusesLayout &layouts) const override;
 #endif
 
     void processBlock(AudioBuffer<float> &, MidiBuffer &) override;
+    void processBlockBypassed(AudioBuffer<float> &, MidiBuffer &) override;
+
+    // Quality level the chorus is running at, 0 being full quality
+    int getQualityLevel() const noexcept;
 
     AudioProcessorEditor *createEditor() override;
     bool hasEditor() const override;
@@ -55,4 +61,17 @@ private:
         chorusIndex
     };
     dsp::ProcessorChain<LushChorus<float>> processorChain;
+
+    AdaptiveQuality adaptiveQuality{LushChorus<float>::numQualityLevels};
+
+    void attachToParameters();
+
+    // Cached on the first prepareToPlay, so applying parameters never looks them up by name
+    std::atomic<float> *rateParam = nullptr, *rateSpreadParam = nullptr, *depthParam = nullptr, *mixParam = nullptr,
+                       *delayParam = nullptr, *spreadParam = nullptr, *enableHighPassParam = nullptr, *highPassCutoffParam = nullptr,
+                       *feedbackParam = nullptr, *invertFeedbackParam = nullptr, *invertParam = nullptr, *panLawParam = nullptr,
+                       *adaptiveQualityParam = nullptr;
+
+    // Set by parameterChanged, picked up by the next processBlock
+    std::atomic<bool> parametersChanged{true};
 };
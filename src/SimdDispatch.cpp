@@ -0,0 +1,157 @@
+#include "SimdDispatch.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+
+#if LILYCHORUS_SIMD_DISPATCH
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace simd
+{
+    namespace
+    {
+#if LILYCHORUS_SIMD_DISPATCH
+        struct CpuidResult
+        {
+            uint32_t eax = 0, ebx = 0, ecx = 0, edx = 0;
+        };
+
+        CpuidResult cpuid(uint32_t leaf, uint32_t subleaf)
+        {
+            CpuidResult result;
+#if defined(_MSC_VER)
+            int registers[4];
+            __cpuidex(registers, (int)leaf, (int)subleaf);
+            result.eax = (uint32_t)registers[0];
+            result.ebx = (uint32_t)registers[1];
+            result.ecx = (uint32_t)registers[2];
+            result.edx = (uint32_t)registers[3];
+#else
+            __cpuid_count(leaf, subleaf, result.eax, result.ebx, result.ecx, result.edx);
+#endif
+            return result;
+        }
+
+        // Which register states the OS saves on context switch, without needing -mxsave
+        uint64_t readXcr0()
+        {
+#if defined(_MSC_VER)
+            return _xgetbv(0);
+#else
+            uint32_t eax = 0, edx = 0;
+            __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+            return ((uint64_t)edx << 32) | eax;
+#endif
+        }
+
+        Isa detectIsa()
+        {
+            const auto maxLeaf = cpuid(0, 0).eax;
+            if (maxLeaf < 1)
+                return Isa::generic;
+
+            // The generic kernels are already built for SSE2, which every x86_64 CPU has,
+            // so there's nothing to switch to short of AVX2
+            const auto leaf1 = cpuid(1, 0);
+            const bool hasOsxsave = (leaf1.ecx & (1u << 27)) != 0;
+            const bool hasAvx = (leaf1.ecx & (1u << 28)) != 0;
+            const bool hasFma = (leaf1.ecx & (1u << 12)) != 0;
+            if (maxLeaf < 7 || !hasOsxsave || !hasAvx || !hasFma)
+                return Isa::generic;
+
+            const auto xcr0 = readXcr0();
+            const bool osSavesYmm = (xcr0 & 0x6) == 0x6;
+            const bool osSavesZmm = (xcr0 & 0xe6) == 0xe6;
+
+            const auto leaf7 = cpuid(7, 0);
+            const bool hasAvx2 = (leaf7.ebx & (1u << 5)) != 0;
+            const bool hasAvx512f = (leaf7.ebx & (1u << 16)) != 0;
+
+            if (!osSavesYmm || !hasAvx2)
+                return Isa::generic;
+
+            if (osSavesZmm && hasAvx512f)
+                return Isa::avx512;
+
+            return Isa::avx2;
+        }
+#else
+        Isa detectIsa()
+        {
+            return Isa::generic;
+        }
+#endif
+
+        Isa selectIsa()
+        {
+            auto isa = getDetectedIsa();
+
+            if (const char *requested = std::getenv("LILYCHORUS_SIMD"))
+            {
+                for (auto candidate : {Isa::generic, Isa::avx2, Isa::avx512})
+                {
+                    if (std::strcmp(requested, getIsaName(candidate)) == 0 && candidate < isa)
+                        isa = candidate;
+                }
+            }
+
+            return isa;
+        }
+    }
+
+    Isa getDetectedIsa()
+    {
+        static const Isa detected = detectIsa();
+        return detected;
+    }
+
+    Isa getActiveIsa()
+    {
+        static const Isa active = selectIsa();
+        return active;
+    }
+
+    const char *getIsaName(Isa isa)
+    {
+        switch (isa)
+        {
+        case Isa::avx2:
+            return "avx2";
+        case Isa::avx512:
+            return "avx512";
+        case Isa::generic:
+        default:
+            return "generic";
+        }
+    }
+
+    template <typename SampleType>
+    const Kernels<SampleType> &getKernels()
+    {
+        static const Kernels<SampleType> &kernels = []() -> const Kernels<SampleType> &
+        {
+            switch (getActiveIsa())
+            {
+#if LILYCHORUS_SIMD_DISPATCH
+            case Isa::avx512:
+                return avx512::getKernels<SampleType>();
+            case Isa::avx2:
+                return avx2::getKernels<SampleType>();
+#endif
+            default:
+                return generic::getKernels<SampleType>();
+            }
+        }();
+
+        return kernels;
+    }
+
+    template const Kernels<float> &getKernels<float>();
+    template const Kernels<double> &getKernels<double>();
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// The chorus hot loops are compiled once per instruction set (see the
+// SimdKernels*.cpp files) and the widest variant the CPU supports is picked
+// the first time any of them is asked for.
+namespace simd
+{
+    enum class Isa
+    {
+        generic,
+        avx2,
+        avx512
+    };
+
+    template <typename SampleType>
+    struct Kernels
+    {
+        // Advances a bank of quadrature oscillators, writing each x output to outputs[voice]
+        void (*generateLfo)(SampleType *x, SampleType *y, const SampleType *e, SampleType *const *outputs, size_t numVoices, size_t numSamples);
+
+        // max(minimum, lfo * depth * modulation + centre) * scale, in place
+        void (*computeDelayTimes)(SampleType *samples, const SampleType *depth, SampleType modulation, SampleType centre, SampleType minimum, SampleType scale, size_t numSamples);
+
+        // Third order Lagrange reads from a power of two ring buffer, sample i is read relative to writePosition + i
+        void (*interpolateTaps)(const SampleType *buffer, uint32_t mask, uint32_t writePosition, const SampleType *delays, SampleType *taps, size_t numSamples);
+
+        // Same as interpolateTaps with linear interpolation, for reduced quality
+        void (*interpolateTapsLinear)(const SampleType *buffer, uint32_t mask, uint32_t writePosition, const SampleType *delays, SampleType *taps, size_t numSamples);
+
+        // Writes input into the ring buffer, adding taps * feedback when taps is not null
+        void (*writeDelay)(SampleType *buffer, uint32_t mask, uint32_t writePosition, const SampleType *input, const SampleType *taps, SampleType feedback, size_t numSamples);
+
+        // One output channel in a single pass: wet = sum over voices of taps[voice] * gain (one row of
+        // the voice to output gain matrix), run through the biquad in filter (b0 b1 b2 a1 a2, state in
+        // filterState) unless that is null, then output = wet * wetGain + dry * dryGain.
+        // All gains ramp linearly by their step per sample. output may be the same buffer as dry.
+        void (*mixVoices)(SampleType *output, const SampleType *dry, const SampleType *const *taps, const SampleType *gains, const SampleType *gainSteps, size_t numVoices,
+                          SampleType wetGain, SampleType wetStep, SampleType dryGain, SampleType dryStep, const SampleType *filter, SampleType *filterState, size_t numSamples);
+
+        // wet = wet * wetGain + dry * dryGain, both gains ramping linearly by their step per sample
+        void (*mixDryWet)(SampleType *wet, const SampleType *dry, SampleType wetGain, SampleType wetStep, SampleType dryGain, SampleType dryStep, size_t numSamples);
+    };
+
+    // The instruction set the kernels run on. Setting the LILYCHORUS_SIMD environment
+    // variable to generic, avx2 or avx512 caps it, which is handy for comparisons.
+    Isa getActiveIsa();
+    Isa getDetectedIsa();
+    const char *getIsaName(Isa isa);
+
+    template <typename SampleType>
+    const Kernels<SampleType> &getKernels();
+
+    namespace generic
+    {
+        template <typename SampleType>
+        const Kernels<SampleType> &getKernels();
+    }
+
+#if LILYCHORUS_SIMD_DISPATCH
+    namespace avx2
+    {
+        template <typename SampleType>
+        const Kernels<SampleType> &getKernels();
+    }
+
+    namespace avx512
+    {
+        template <typename SampleType>
+        const Kernels<SampleType> &getKernels();
+    }
+#endif
+}
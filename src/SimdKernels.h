@@ -0,0 +1,253 @@
+// Kernel bodies shared by every SimdKernels*.cpp. There is deliberately no
+// include guard: each of those files defines LILYCHORUS_KERNEL_NAMESPACE,
+// includes this once and gets its own copy compiled with its own -m/arch flags.
+//
+// Keep everything in here plain loops over restrict pointers so the compiler can
+// vectorise them for the target, and don't call inline functions from other
+// headers (std::max and friends): those would be emitted with the wider
+// instruction set and could get picked by the linker for baseline code.
+
+#include "SimdDispatch.h"
+
+#ifndef LILYCHORUS_KERNEL_NAMESPACE
+#error "Define LILYCHORUS_KERNEL_NAMESPACE before including SimdKernels.h"
+#endif
+
+#if defined(_MSC_VER)
+#define LILYCHORUS_RESTRICT __restrict
+#else
+#define LILYCHORUS_RESTRICT __restrict__
+#endif
+
+namespace simd
+{
+    namespace LILYCHORUS_KERNEL_NAMESPACE
+    {
+        namespace
+        {
+            // Oscillators are advanced in groups of lanes so the voice loop has a fixed trip count
+            constexpr size_t lfoLanes = 4;
+
+            template <typename SampleType>
+            void generateLfo(SampleType *x, SampleType *y, const SampleType *e, SampleType *const *outputs, size_t numVoices, size_t numSamples)
+            {
+                for (size_t first = 0; first < numVoices; first += lfoLanes)
+                {
+                    const size_t lanes = numVoices - first < lfoLanes ? numVoices - first : lfoLanes;
+
+                    SampleType lx[lfoLanes] = {}, ly[lfoLanes] = {}, le[lfoLanes] = {};
+                    SampleType *out[lfoLanes] = {};
+
+                    for (size_t lane = 0; lane < lanes; ++lane)
+                    {
+                        lx[lane] = x[first + lane];
+                        ly[lane] = y[first + lane];
+                        le[lane] = e[first + lane];
+                        out[lane] = outputs[first + lane];
+                    }
+
+                    for (size_t i = 0; i < numSamples; ++i)
+                    {
+                        for (size_t lane = 0; lane < lfoLanes; ++lane)
+                        {
+                            lx[lane] = lx[lane] - le[lane] * ly[lane];
+                            ly[lane] = le[lane] * lx[lane] + ly[lane];
+                        }
+
+                        for (size_t lane = 0; lane < lanes; ++lane)
+                            out[lane][i] = lx[lane];
+                    }
+
+                    for (size_t lane = 0; lane < lanes; ++lane)
+                    {
+                        x[first + lane] = lx[lane];
+                        y[first + lane] = ly[lane];
+                    }
+                }
+            }
+
+            template <typename SampleType>
+            void computeDelayTimes(SampleType *LILYCHORUS_RESTRICT samples, const SampleType *LILYCHORUS_RESTRICT depth,
+                                   SampleType modulation, SampleType centre, SampleType minimum, SampleType scale, size_t numSamples)
+            {
+                for (size_t i = 0; i < numSamples; ++i)
+                {
+                    const SampleType ms = modulation * depth[i] * samples[i] + centre;
+                    samples[i] = (ms < minimum ? minimum : ms) * scale;
+                }
+            }
+
+            template <typename SampleType>
+            void interpolateTaps(const SampleType *LILYCHORUS_RESTRICT buffer, uint32_t mask, uint32_t writePosition,
+                                 const SampleType *LILYCHORUS_RESTRICT delays, SampleType *LILYCHORUS_RESTRICT taps, size_t numSamples)
+            {
+                const SampleType half = static_cast<SampleType>(0.5);
+                const SampleType sixth = static_cast<SampleType>(1.0 / 6.0);
+
+                for (size_t i = 0; i < numSamples; ++i)
+                {
+                    const SampleType delay = delays[i];
+                    const auto whole = static_cast<int32_t>(delay);
+                    const SampleType f = delay - static_cast<SampleType>(whole);
+
+                    // Points at -1, 0, 1 and 2 around the integer delay, interpolated at f
+                    const uint32_t newest = writePosition + static_cast<uint32_t>(i) + 1u - static_cast<uint32_t>(whole);
+                    const SampleType v0 = buffer[newest & mask];
+                    const SampleType v1 = buffer[(newest - 1u) & mask];
+                    const SampleType v2 = buffer[(newest - 2u) & mask];
+                    const SampleType v3 = buffer[(newest - 3u) & mask];
+
+                    const SampleType d0 = f + 1, d1 = f, d2 = f - 1, d3 = f - 2;
+                    const SampleType c0 = -d1 * d2 * d3 * sixth;
+                    const SampleType c1 = d0 * d2 * d3 * half;
+                    const SampleType c2 = -d0 * d1 * d3 * half;
+                    const SampleType c3 = d0 * d1 * d2 * sixth;
+
+                    taps[i] = v0 * c0 + v1 * c1 + v2 * c2 + v3 * c3;
+                }
+            }
+
+            template <typename SampleType>
+            void interpolateTapsLinear(const SampleType *LILYCHORUS_RESTRICT buffer, uint32_t mask, uint32_t writePosition,
+                                       const SampleType *LILYCHORUS_RESTRICT delays, SampleType *LILYCHORUS_RESTRICT taps, size_t numSamples)
+            {
+                for (size_t i = 0; i < numSamples; ++i)
+                {
+                    const SampleType delay = delays[i];
+                    const auto whole = static_cast<int32_t>(delay);
+                    const SampleType f = delay - static_cast<SampleType>(whole);
+
+                    const uint32_t at = writePosition + static_cast<uint32_t>(i) - static_cast<uint32_t>(whole);
+                    const SampleType a = buffer[at & mask];
+                    const SampleType b = buffer[(at - 1u) & mask];
+
+                    taps[i] = a + f * (b - a);
+                }
+            }
+
+            template <typename SampleType>
+            void writeDelay(SampleType *LILYCHORUS_RESTRICT buffer, uint32_t mask, uint32_t writePosition,
+                            const SampleType *LILYCHORUS_RESTRICT input, const SampleType *LILYCHORUS_RESTRICT taps,
+                            SampleType feedback, size_t numSamples)
+            {
+                if (taps == nullptr)
+                {
+                    for (size_t i = 0; i < numSamples; ++i)
+                        buffer[(writePosition + static_cast<uint32_t>(i)) & mask] = input[i];
+                }
+                else
+                {
+                    // Recirculated samples are snapped to zero once they are far below hearing, so a
+                    // decaying tail never becomes denormal, even with the FPU's flush to zero off
+                    const SampleType tiny = static_cast<SampleType>(1.0e-8);
+
+                    for (size_t i = 0; i < numSamples; ++i)
+                    {
+                        const SampleType value = input[i] + taps[i] * feedback;
+                        buffer[(writePosition + static_cast<uint32_t>(i)) & mask] = value < tiny && value > -tiny ? 0 : value;
+                    }
+                }
+            }
+
+            // Samples mixVoices works on at once; small enough to stay in registers
+            constexpr size_t mixTile = 32;
+
+            // output and dry may be the same buffer: each tile of dry is read before
+            // that tile of output is written, so neither of them is restrict
+            template <typename SampleType>
+            void mixVoices(SampleType *output, const SampleType *dry, const SampleType *const *taps, const SampleType *gains,
+                           const SampleType *gainSteps, size_t numVoices, SampleType wetGain, SampleType wetStep,
+                           SampleType dryGain, SampleType dryStep, const SampleType *filter, SampleType *filterState, size_t numSamples)
+            {
+                SampleType s1 = filter != nullptr ? filterState[0] : 0;
+                SampleType s2 = filter != nullptr ? filterState[1] : 0;
+
+                for (size_t start = 0; start < numSamples; start += mixTile)
+                {
+                    const size_t count = numSamples - start < mixTile ? numSamples - start : mixTile;
+                    SampleType wet[mixTile], held[mixTile];
+
+                    for (size_t i = 0; i < count; ++i)
+                    {
+                        wet[i] = 0;
+                        held[i] = dry[start + i];
+                    }
+
+                    // Ramp positions go through int32_t: 64 bit integer to float conversions don't vectorise
+                    for (size_t voice = 0; voice < numVoices; ++voice)
+                    {
+                        const SampleType *LILYCHORUS_RESTRICT tap = taps[voice] + start;
+                        const SampleType gain = gains[voice] + gainSteps[voice] * static_cast<SampleType>(static_cast<int32_t>(start));
+                        const SampleType step = gainSteps[voice];
+
+                        for (size_t i = 0; i < count; ++i)
+                            wet[i] += tap[i] * (gain + step * static_cast<SampleType>(static_cast<int32_t>(i)));
+                    }
+
+                    if (filter != nullptr)
+                    {
+                        // Transposed direct form II, the same as juce::dsp::IIR::Filter
+                        const SampleType b0 = filter[0], b1 = filter[1], b2 = filter[2], a1 = filter[3], a2 = filter[4];
+
+                        for (size_t i = 0; i < count; ++i)
+                        {
+                            const SampleType x = wet[i];
+                            const SampleType y = b0 * x + s1;
+                            s1 = b1 * x - a1 * y + s2;
+                            s2 = b2 * x - a2 * y;
+                            wet[i] = y;
+                        }
+                    }
+
+                    const SampleType tileWet = wetGain + wetStep * static_cast<SampleType>(static_cast<int32_t>(start));
+                    const SampleType tileDry = dryGain + dryStep * static_cast<SampleType>(static_cast<int32_t>(start));
+
+                    for (size_t i = 0; i < count; ++i)
+                    {
+                        const auto n = static_cast<SampleType>(static_cast<int32_t>(i));
+                        output[start + i] = wet[i] * (tileWet + wetStep * n) + held[i] * (tileDry + dryStep * n);
+                    }
+                }
+
+                if (filter != nullptr)
+                {
+                    // Let the filter state decay to zero rather than into denormals
+                    const SampleType tiny = static_cast<SampleType>(1.0e-8);
+                    filterState[0] = s1 < tiny && s1 > -tiny ? 0 : s1;
+                    filterState[1] = s2 < tiny && s2 > -tiny ? 0 : s2;
+                }
+            }
+
+            template <typename SampleType>
+            void mixDryWet(SampleType *LILYCHORUS_RESTRICT wet, const SampleType *LILYCHORUS_RESTRICT dry,
+                           SampleType wetGain, SampleType wetStep, SampleType dryGain, SampleType dryStep, size_t numSamples)
+            {
+                for (size_t i = 0; i < numSamples; ++i)
+                {
+                    const auto n = static_cast<SampleType>(static_cast<int32_t>(i));
+                    wet[i] = wet[i] * (wetGain + wetStep * n) + dry[i] * (dryGain + dryStep * n);
+                }
+            }
+        }
+
+        template <typename SampleType>
+        const Kernels<SampleType> &getKernels()
+        {
+            static const Kernels<SampleType> kernels{
+                &generateLfo<SampleType>,
+                &computeDelayTimes<SampleType>,
+                &interpolateTaps<SampleType>,
+                &interpolateTapsLinear<SampleType>,
+                &writeDelay<SampleType>,
+                &mixVoices<SampleType>,
+                &mixDryWet<SampleType>};
+
+            return kernels;
+        }
+
+        template const Kernels<float> &getKernels<float>();
+        template const Kernels<double> &getKernels<double>();
+    }
+}
+
+#undef LILYCHORUS_RESTRICT
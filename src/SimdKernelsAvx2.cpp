@@ -0,0 +1,4 @@
+// AVX2 kernels. CMakeLists.txt compiles this file with the matching
+// instruction set flags; SimdDispatch.cpp only calls into it after CPUID says so.
+#define LILYCHORUS_KERNEL_NAMESPACE avx2
+#include "SimdKernels.h"
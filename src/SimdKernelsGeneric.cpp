@@ -0,0 +1,4 @@
+// Baseline kernels, built with the project's default flags. This is the only
+// variant on non-x86 targets or when LILYCHORUS_SIMD_DISPATCH is off.
+#define LILYCHORUS_KERNEL_NAMESPACE generic
+#include "SimdKernels.h"
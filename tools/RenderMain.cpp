@@ -0,0 +1,70 @@
+#include <juce_core/juce_core.h>
+
+#include <iostream>
+
+#include "LilyChorusCore.h"
+#include "StreamingRenderer.h"
+#include "ToolOptions.h"
+
+namespace
+{
+    constexpr const char *usage = "Usage: LilyChorusRender <input.wav> <output.wav> [options]\n"
+                                  "\n"
+                                  "  --rate=<hz>  --rate-spread=<0..1>  --depth=<0..1>  --mix=<0..1>\n"
+                                  "  --delay=<ms>  --spread=<0.5..1>  --feedback=<0..1>\n"
+                                  "  --highpass=<hz>  --invert-feedback  --invert  --equal-power\n"
+                                  "  --block=<samples>  --bits=<16|24|32>\n";
+}
+
+int main(int argc, char *argv[])
+{
+    juce::ArgumentList args(argc, argv);
+
+    if (printUsageIfNeeded(args, usage, 2))
+        return 1;
+
+    const auto inputFile = args[0].resolveAsFile();
+    const auto outputFile = args[1].resolveAsFile();
+
+    lilychorus_params params;
+    lilychorus_default_params(&params);
+    params.rate = getOption(args, "--rate", params.rate);
+    params.rate_spread = getOption(args, "--rate-spread", params.rate_spread);
+    params.depth = getOption(args, "--depth", params.depth);
+    params.mix = getOption(args, "--mix", params.mix);
+    params.delay_ms = getOption(args, "--delay", params.delay_ms);
+    params.spread = getOption(args, "--spread", params.spread);
+    params.feedback = getOption(args, "--feedback", params.feedback);
+    params.enable_highpass = args.containsOption("--highpass") ? 1 : 0;
+    params.highpass_cutoff = getOption(args, "--highpass", params.highpass_cutoff);
+    params.invert_feedback = args.containsOption("--invert-feedback") ? 1 : 0;
+    params.invert = args.containsOption("--invert") ? 1 : 0;
+    params.pan_law = args.containsOption("--equal-power") ? 1 : 0;
+
+    StreamingRenderer::Options options;
+    options.blockSize = (int)getOption(args, "--block", options.blockSize);
+    options.bitsPerSample = (int)getOption(args, "--bits", options.bitsPerSample);
+
+    std::unique_ptr<lilychorus, decltype(&lilychorus_destroy)> chorus(lilychorus_create(LILYCHORUS_FLOAT32), &lilychorus_destroy);
+    if (chorus == nullptr || lilychorus_set_params(chorus.get(), &params) != LILYCHORUS_OK)
+    {
+        std::cerr << "Couldn't create the chorus\n";
+        return 1;
+    }
+
+    StreamingRenderer renderer(*chorus, options);
+
+    const auto startTicks = juce::Time::getHighResolutionTicks();
+    const auto result = renderer.render(inputFile, outputFile);
+    const auto seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+
+    if (result.failed())
+    {
+        std::cerr << result.getErrorMessage() << "\n";
+        return 1;
+    }
+
+    std::cout << "Rendered " << renderer.getNumSamplesRendered() << " samples in " << seconds << "s ("
+              << lilychorus_simd_path() << " kernels)\n";
+    return 0;
+}
@@ -0,0 +1,137 @@
+#include <juce_audio_processors/juce_audio_processors.h>
+#include <juce_core/juce_core.h>
+#include <juce_events/juce_events.h>
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "ToolOptions.h"
+
+// Measures what a host pays for the plugin before any audio is heard: a scan
+// (construct, query, destroy) and opening a session full of instances
+// (construct, prepare, first block, editor open).
+
+juce::AudioProcessor *JUCE_CALLTYPE createPluginFilter();
+
+namespace
+{
+    class Phase
+    {
+    public:
+        explicit Phase(const char *nameToUse) : name(nameToUse) {}
+
+        template <typename Function>
+        void time(Function &&function)
+        {
+            const auto startTicks = juce::Time::getHighResolutionTicks();
+            function();
+            samples.push_back(juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks));
+        }
+
+        void print() const
+        {
+            if (samples.empty())
+                return;
+
+            auto sorted = samples;
+            std::sort(sorted.begin(), sorted.end());
+
+            double total = 0.0;
+            for (auto seconds : sorted)
+                total += seconds;
+
+            std::cout << juce::String(name).paddedRight(' ', 14)
+                      << " total " << juce::String(total * 1000.0, 2).paddedLeft(' ', 9) << " ms"
+                      << "   mean " << juce::String(total * 1.0e6 / (double)sorted.size(), 1).paddedLeft(' ', 9) << " us"
+                      << "   median " << juce::String(sorted[sorted.size() / 2] * 1.0e6, 1).paddedLeft(' ', 9) << " us"
+                      << "   max " << juce::String(sorted.back() * 1.0e6, 1).paddedLeft(' ', 9) << " us\n";
+        }
+
+    private:
+        const char *name;
+        std::vector<double> samples;
+    };
+
+    constexpr const char *usage = "Usage: LilyChorusStartupBenchmark [--instances=300] [--scans=100]\n"
+                                  "                                  [--sample-rate=48000] [--block=512]\n";
+}
+
+int main(int argc, char *argv[])
+{
+    juce::ArgumentList args(argc, argv);
+
+    if (printUsageIfNeeded(args, usage))
+        return 1;
+
+    const auto numInstances = juce::jmax(1, (int)getOption(args, "--instances", 300));
+    const auto numScans = juce::jmax(0, (int)getOption(args, "--scans", 100));
+    const auto sampleRate = getOption(args, "--sample-rate", 48000.0);
+    const auto blockSize = juce::jmax(1, (int)getOption(args, "--block", 512));
+
+    // Editors need the message manager, and this thread to be its message thread
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    // The first instance pays for one-off static setup, so time it on its own
+    Phase firstInstance("first instance");
+    firstInstance.time([] { delete createPluginFilter(); });
+
+    Phase scan("scan");
+    for (int i = 0; i < numScans; ++i)
+    {
+        scan.time([]
+        {
+            std::unique_ptr<juce::AudioProcessor> processor(createPluginFilter());
+            juce::MemoryBlock state;
+            processor->getStateInformation(state);
+            juce::ignoreUnused(processor->getParameters().size(), processor->getBusCount(true), processor->hasEditor());
+        });
+    }
+
+    std::vector<std::unique_ptr<juce::AudioProcessor>> processors;
+    processors.reserve((size_t)numInstances);
+
+    Phase construct("construct"), prepare("prepare"), firstBlock("first block"), editorOpen("editor open"), destroy("destroy");
+
+    for (int i = 0; i < numInstances; ++i)
+        construct.time([&] { processors.emplace_back(createPluginFilter()); });
+
+    for (auto &processor : processors)
+    {
+        prepare.time([&]
+        {
+            processor->setRateAndBufferSizeDetails(sampleRate, blockSize);
+            processor->prepareToPlay(sampleRate, blockSize);
+        });
+    }
+
+    juce::AudioBuffer<float> buffer(2, blockSize);
+    juce::MidiBuffer midi;
+    juce::Random random(1);
+
+    for (auto &processor : processors)
+    {
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+            for (int sample = 0; sample < blockSize; ++sample)
+                buffer.setSample(channel, sample, random.nextFloat() * 2.0f - 1.0f);
+
+        firstBlock.time([&] { processor->processBlock(buffer, midi); });
+    }
+
+    for (auto &processor : processors)
+    {
+        // Opened and closed again, like a user clicking through the session
+        editorOpen.time([&] { std::unique_ptr<juce::AudioProcessorEditor> editor(processor->createEditorIfNeeded()); });
+    }
+
+    for (auto &processor : processors)
+        destroy.time([&] { processor.reset(); });
+
+    std::cout << numInstances << " instances at " << sampleRate << " Hz, " << blockSize << " sample blocks\n\n";
+
+    for (const auto *phase : {&firstInstance, &scan, &construct, &prepare, &firstBlock, &editorOpen, &destroy})
+        phase->print();
+
+    return 0;
+}
@@ -0,0 +1,162 @@
+#include "StreamingRenderer.h"
+
+StreamingRenderer::StreamingRenderer(lilychorus &chorusToUse, Options optionsToUse)
+    : juce::Thread("LilyChorus render I/O"),
+      chorus(chorusToUse),
+      options(optionsToUse)
+{
+    options.blockSize = juce::jmax(1, options.blockSize);
+    options.mapWindowBlocks = juce::jmax(1, options.mapWindowBlocks);
+}
+
+StreamingRenderer::~StreamingRenderer()
+{
+    stopThread(-1);
+}
+
+int StreamingRenderer::getBlockLength(juce::int64 block) const
+{
+    return (int)juce::jmin((juce::int64)options.blockSize, totalSamples - block * options.blockSize);
+}
+
+juce::Result StreamingRenderer::render(const juce::File &inputFile, const juce::File &outputFile)
+{
+    juce::WavAudioFormat wav;
+
+    reader.reset(wav.createMemoryMappedReader(inputFile));
+    if (reader == nullptr)
+        return juce::Result::fail("Couldn't open " + inputFile.getFullPathName() + " as a WAV or RF64 file");
+
+    numChannels = (int)reader->numChannels;
+    if (numChannels > 2)
+        return juce::Result::fail("Only mono and stereo files can be rendered, " + inputFile.getFileName() + " has " + juce::String(numChannels) + " channels");
+
+    totalSamples = reader->lengthInSamples;
+    totalBlocks = (totalSamples + options.blockSize - 1) / options.blockSize;
+
+    outputFile.deleteFile();
+    std::unique_ptr<juce::OutputStream> stream = outputFile.createOutputStream();
+    if (stream == nullptr)
+        return juce::Result::fail("Couldn't create " + outputFile.getFullPathName());
+
+    // JUCE switches the header to RF64 by itself once the data passes 4GB
+    const int bitsPerSample = options.bitsPerSample > 0 ? options.bitsPerSample : (int)reader->bitsPerSample;
+    writer.reset(wav.createWriterFor(stream.get(), reader->sampleRate, (unsigned int)numChannels, bitsPerSample, {}, 0));
+    if (writer == nullptr)
+        return juce::Result::fail("Can't write " + juce::String(bitsPerSample) + " bit WAV files");
+
+    // The writer owns the stream now
+    stream.release();
+
+    if (lilychorus_prepare(&chorus, reader->sampleRate, (uint32_t)options.blockSize, (uint32_t)numChannels, 0) != LILYCHORUS_OK)
+        return juce::Result::fail("Couldn't prepare the chorus");
+
+    for (auto &slot : slots)
+        slot.setSize(numChannels, options.blockSize);
+
+    blocksRead = 0;
+    blocksProcessed = 0;
+    blocksWritten = 0;
+    ioFailed = false;
+    samplesRendered = 0;
+
+    startThread();
+
+    auto status = LILYCHORUS_OK;
+
+    for (juce::int64 block = 0; block < totalBlocks; ++block)
+    {
+        while (blocksRead.load() <= block && !ioFailed.load())
+            blockRead.wait(100);
+
+        if (ioFailed.load())
+            break;
+
+        const auto length = getBlockLength(block);
+        auto &slot = slots[(size_t)(block % numSlots)];
+        status = lilychorus_process_planar_f32(&chorus, slot.getArrayOfWritePointers(), (uint32_t)numChannels, (uint32_t)length);
+
+        if (status != LILYCHORUS_OK)
+        {
+            // Stop the I/O thread too, rather than write out audio that was never processed
+            ioFailed = true;
+            signalThreadShouldExit();
+            blockProcessed.signal();
+            break;
+        }
+
+        samplesRendered += length;
+        blocksProcessed = block + 1;
+        blockProcessed.signal();
+    }
+
+    waitForThreadToExit(-1);
+
+    // Flushes and finalises the header
+    writer.reset();
+    reader.reset();
+
+    if (status != LILYCHORUS_OK)
+        return juce::Result::fail("The chorus failed to process block " + juce::String(blocksProcessed.load()) + ", status " + juce::String((int)status));
+
+    if (ioFailed.load())
+        return juce::Result::fail("Reading " + inputFile.getFullPathName() + " or writing " + outputFile.getFullPathName() + " failed");
+
+    return juce::Result::ok();
+}
+
+bool StreamingRenderer::readBlock(juce::int64 block)
+{
+    const auto start = block * options.blockSize;
+    const auto length = getBlockLength(block);
+
+    // Only a window of the file is mapped at a time, so resident memory stays flat
+    if (!reader->getMappedSection().contains(juce::Range<juce::int64>(start, start + length)))
+    {
+        const auto windowEnd = juce::jmin(totalSamples, start + (juce::int64)options.blockSize * options.mapWindowBlocks);
+        if (!reader->mapSectionOfFile(juce::Range<juce::int64>(start, windowEnd)))
+            return false;
+    }
+
+    return reader->read(slots[(size_t)(block % numSlots)].getArrayOfWritePointers(), numChannels, start, length);
+}
+
+void StreamingRenderer::run()
+{
+    while (!threadShouldExit() && blocksWritten.load() < totalBlocks)
+    {
+        bool didSomething = false;
+
+        // Write behind
+        const auto written = blocksWritten.load();
+        if (written < blocksProcessed.load())
+        {
+            if (!writer->writeFromAudioSampleBuffer(slots[(size_t)(written % numSlots)], 0, getBlockLength(written)))
+                break;
+
+            blocksWritten = written + 1;
+            didSomething = true;
+        }
+
+        // Read ahead into whichever slot has been written out
+        const auto read = blocksRead.load();
+        if (read < totalBlocks && read - blocksWritten.load() < numSlots)
+        {
+            if (!readBlock(read))
+                break;
+
+            blocksRead = read + 1;
+            blockRead.signal();
+            didSomething = true;
+        }
+
+        if (!didSomething)
+            blockProcessed.wait(100);
+    }
+
+    if (blocksWritten.load() < totalBlocks)
+    {
+        ioFailed = true;
+        blockRead.signal();
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <juce_core/juce_core.h>
+
+#include <array>
+#include <atomic>
+#include <memory>
+
+#include "LilyChorusCore.h"
+
+// Renders a WAV/RF64 file through the chorus without ever holding it in memory.
+// The input is memory mapped a window at a time, and a background thread reads
+// blocks ahead and writes processed ones behind while the calling thread runs
+// the DSP. Only numSlots blocks are in flight, whatever the file length.
+class StreamingRenderer : private juce::Thread
+{
+public:
+    struct Options
+    {
+        int blockSize = 4096;
+        int bitsPerSample = 0; // 0 keeps the input's
+        int mapWindowBlocks = 64;
+    };
+
+    // The chorus must have its parameters set already; render() prepares it for the file
+    StreamingRenderer(lilychorus &chorusToUse, Options optionsToUse);
+    ~StreamingRenderer() override;
+
+    juce::Result render(const juce::File &inputFile, const juce::File &outputFile);
+
+    juce::int64 getNumSamplesRendered() const { return samplesRendered; }
+
+private:
+    static constexpr int numSlots = 3;
+
+    void run() override;
+    bool readBlock(juce::int64 block);
+    int getBlockLength(juce::int64 block) const;
+
+    lilychorus &chorus;
+    Options options;
+
+    std::unique_ptr<juce::MemoryMappedAudioFormatReader> reader;
+    std::unique_ptr<juce::AudioFormatWriter> writer;
+    std::array<juce::AudioBuffer<float>, numSlots> slots;
+
+    int numChannels = 0;
+    juce::int64 totalSamples = 0, totalBlocks = 0, samplesRendered = 0;
+
+    // Block n lives in slots[n % numSlots] from being read until it has been written
+    std::atomic<juce::int64> blocksRead{0}, blocksProcessed{0}, blocksWritten{0};
+    std::atomic<bool> ioFailed{false};
+    juce::WaitableEvent blockRead, blockProcessed;
+
+    JUCE_DECLARE_NON_COPYABLE(StreamingRenderer)
+};
@@ -0,0 +1,277 @@
+#include <juce_audio_processors/juce_audio_processors.h>
+#include <juce_core/juce_core.h>
+#include <juce_events/juce_events.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iterator>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "PluginProcessor.h"
+#include "ToolOptions.h"
+
+// Plays ChorusAudioProcessor the way a badly behaved host would and records how
+// long every block took. The audio loop picks a random block size for each call
+// (one sample blocks included, and blocks larger than the one prepared for),
+// re-prepares at a random sample rate now and then, and toggles bypass. A second
+// thread meanwhile automates every parameter as fast as it can and saves and
+// restores the state. Each block's time is taken as a share of how long the block
+// lasts at the current sample rate. Exits non-zero if the --percentile share is
+// over the budget, or if the output ever stops being finite. The slowest block is
+// reported but not judged, as one preemption by the scheduler can make any block
+// slow. Before all that it checks that the chorus gets back to full quality when
+// adaptive quality is turned off after a re-prepare.
+
+juce::AudioProcessor *JUCE_CALLTYPE createPluginFilter();
+
+namespace
+{
+    constexpr const char *usage = "Usage: LilyChorusStressHarness [--blocks=200000] [--max-block=2048] [--budget=0.5]\n"
+                                  "                               [--percentile=99.9] [--seed=1]\n";
+
+    // Stands in for the host's message thread
+    class HostileAutomation : public juce::Thread
+    {
+    public:
+        HostileAutomation(juce::AudioProcessor &processorToUse, juce::int64 seed)
+            : juce::Thread("LilyChorus hostile automation"),
+              processor(processorToUse),
+              random(seed)
+        {
+        }
+
+        ~HostileAutomation() override
+        {
+            stopThread(-1);
+        }
+
+        void run() override
+        {
+            const auto &parameters = processor.getParameters();
+
+            while (!threadShouldExit())
+            {
+                for (auto *parameter : parameters)
+                {
+                    parameter->beginChangeGesture();
+                    parameter->setValueNotifyingHost(random.nextFloat());
+                    parameter->endChangeGesture();
+                }
+
+                ++automationPasses;
+
+                if (random.nextInt(64) == 0)
+                {
+                    juce::MemoryBlock state;
+                    processor.getStateInformation(state);
+                    processor.setStateInformation(state.getData(), (int)state.getSize());
+                    ++stateRestores;
+                }
+            }
+        }
+
+        std::atomic<juce::int64> automationPasses{0}, stateRestores{0};
+
+    private:
+        juce::AudioProcessor &processor;
+        juce::Random random;
+    };
+
+    // Drives the chorus down to a reduced quality, re-prepares while it is there and then
+    // turns adaptive quality off, which has to bring it back to full quality. Returns
+    // false if it doesn't. Skipped if the machine is too fast to ever look overloaded.
+    bool checkQualityRecovers(ChorusAudioProcessor &processor)
+    {
+        auto *adaptiveQuality = processor.state.getParameter("adaptive_quality");
+        adaptiveQuality->setValueNotifyingHost(1.0f);
+
+        // A single sample lasts an eighth of a microsecond here, less than processing it takes
+        const double overloadedRate = 8.0e6;
+        processor.setRateAndBufferSizeDetails(overloadedRate, 1);
+        processor.prepareToPlay(overloadedRate, 1);
+
+        juce::AudioBuffer<float> buffer(2, 512);
+        juce::MidiBuffer midi;
+
+        {
+            juce::AudioBuffer<float> sample(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), 1);
+            for (int block = 0; block < 2000000 && processor.getQualityLevel() == 0; ++block)
+                processor.processBlock(sample, midi);
+        }
+
+        if (processor.getQualityLevel() == 0)
+        {
+            std::cout << "Quality recovery check skipped: adaptive quality never stepped down\n\n";
+            return true;
+        }
+
+        const auto degradedLevel = processor.getQualityLevel();
+
+        processor.setRateAndBufferSizeDetails(48000.0, buffer.getNumSamples());
+        processor.prepareToPlay(48000.0, buffer.getNumSamples());
+        adaptiveQuality->setValueNotifyingHost(0.0f);
+
+        buffer.clear();
+        processor.processBlock(buffer, midi);
+
+        const bool recovered = processor.getQualityLevel() == 0;
+        std::cout << "Quality recovery check: re-prepared at level " << degradedLevel << ", adaptive off, now at level "
+                  << processor.getQualityLevel() << (recovered ? "\n\n" : "\n\nFAIL: the chorus stayed at reduced quality\n\n");
+        return recovered;
+    }
+
+    struct BlockTiming
+    {
+        double seconds;
+        int numSamples;
+        double sampleRate;
+
+        // Share of the block's real-time duration spent processing it
+        double getLoad() const { return seconds * sampleRate / numSamples; }
+    };
+}
+
+int main(int argc, char *argv[])
+{
+    juce::ArgumentList args(argc, argv);
+
+    if (printUsageIfNeeded(args, usage))
+        return 1;
+
+    const auto numBlocks = juce::jmax(1, (int)getOption(args, "--blocks", 200000));
+    const auto maxBlockSize = juce::jmax(1, (int)getOption(args, "--max-block", 2048));
+    const auto budget = getOption(args, "--budget", 0.5);
+    const auto judgedPercentile = juce::jlimit(0.0, 100.0, getOption(args, "--percentile", 99.9));
+    const auto seed = (juce::int64)getOption(args, "--seed", 1);
+
+    // The parameter state needs a message manager, even though its loop never runs
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    std::unique_ptr<juce::AudioProcessor> processor(createPluginFilter());
+    juce::Random random(seed);
+
+    const bool qualityRecovers = checkQualityRecovers(*dynamic_cast<ChorusAudioProcessor *>(processor.get()));
+
+    static constexpr double sampleRates[] = {44100.0, 48000.0, 88200.0, 96000.0, 192000.0};
+    double sampleRate = 0.0;
+    auto prepare = [&]
+    {
+        sampleRate = sampleRates[random.nextInt((int)std::size(sampleRates))];
+        const auto announcedBlockSize = 1 + random.nextInt(maxBlockSize);
+        processor->releaseResources();
+        processor->setRateAndBufferSizeDetails(sampleRate, announcedBlockSize);
+        processor->prepareToPlay(sampleRate, announcedBlockSize);
+    };
+
+    prepare();
+
+    // Allocated up front so nothing but the processor runs inside the timed region
+    juce::AudioBuffer<float> storage(2, maxBlockSize);
+    juce::MidiBuffer midi;
+    std::vector<BlockTiming> timings;
+    timings.reserve((size_t)numBlocks);
+
+    int prepares = 1, bypassedBlocks = 0, nonFiniteBlocks = 0;
+    bool bypassed = false;
+    float phase = 0.0f;
+
+    HostileAutomation automation(*processor, seed + 1);
+    automation.startThread();
+
+    for (int block = 0; block < numBlocks; ++block)
+    {
+        if (random.nextInt(2000) == 0)
+        {
+            prepare();
+            ++prepares;
+        }
+
+        if (random.nextInt(500) == 0)
+            bypassed = !bypassed;
+
+        // Plenty of single samples and tiny blocks, the rest anywhere up to the maximum
+        const auto numSamples = random.nextInt(10) == 0 ? 1 : 1 + random.nextInt(random.nextBool() ? 32 : maxBlockSize);
+
+        juce::AudioBuffer<float> buffer(storage.getArrayOfWritePointers(), storage.getNumChannels(), numSamples);
+        for (int sample = 0; sample < numSamples; ++sample)
+        {
+            // A decaying tone with a little noise, so the feedback path and denormals get exercised too
+            const auto value = std::sin(phase) * (block % 4000 < 2000 ? 0.5f : 0.0f) + (random.nextFloat() - 0.5f) * 1.0e-3f;
+            phase = std::fmod(phase + 0.05f, juce::MathConstants<float>::twoPi);
+
+            for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+                buffer.setSample(channel, sample, value);
+        }
+
+        const auto startTicks = juce::Time::getHighResolutionTicks();
+
+        if (bypassed)
+            processor->processBlockBypassed(buffer, midi);
+        else
+            processor->processBlock(buffer, midi);
+
+        const auto seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+        timings.push_back({seconds, numSamples, sampleRate});
+
+        bypassedBlocks += bypassed ? 1 : 0;
+
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+        {
+            const auto range = buffer.findMinMax(channel, 0, numSamples);
+            if (!std::isfinite(range.getStart()) || !std::isfinite(range.getEnd()))
+            {
+                ++nonFiniteBlocks;
+                break;
+            }
+        }
+    }
+
+    automation.stopThread(-1);
+
+    const auto worst = *std::max_element(timings.begin(), timings.end(),
+                                         [](const BlockTiming &a, const BlockTiming &b)
+                                         { return a.getLoad() < b.getLoad(); });
+
+    std::vector<double> sorted;
+    sorted.reserve(timings.size());
+    for (const auto &timing : timings)
+        sorted.push_back(timing.getLoad());
+    std::sort(sorted.begin(), sorted.end());
+
+    auto percentile = [&](double p)
+    {
+        const auto index = (size_t)std::ceil(p / 100.0 * (double)sorted.size()) - 1;
+        return sorted[juce::jlimit((size_t)0, sorted.size() - 1, index)];
+    };
+
+    std::cout << numBlocks << " blocks (" << bypassedBlocks << " bypassed), " << prepares << " prepares, "
+              << automation.automationPasses.load() << " automation passes, " << automation.stateRestores.load() << " state restores\n\n";
+
+    std::cout << "Time spent processing, as a share of each block's duration:\n";
+
+    for (auto p : {50.0, 90.0, 99.0, 99.9, 99.99})
+        std::cout << "p" << juce::String(p).paddedRight(' ', 6) << juce::String(percentile(p) * 100.0, 2).paddedLeft(' ', 10) << " %\n";
+
+    std::cout << "max    " << juce::String(worst.getLoad() * 100.0, 2).paddedLeft(' ', 10) << " % ("
+              << juce::String(worst.seconds * 1.0e6, 2) << " us for " << worst.numSamples << " samples at " << worst.sampleRate << " Hz)\n"
+              << "budget " << juce::String(budget * 100.0, 2).paddedLeft(' ', 10) << " % at p" << judgedPercentile << "\n";
+
+    bool failed = !qualityRecovers;
+
+    if (nonFiniteBlocks > 0)
+    {
+        std::cout << "\nFAIL: " << nonFiniteBlocks << " blocks produced NaN or infinite samples\n";
+        failed = true;
+    }
+
+    if (percentile(judgedPercentile) > budget)
+    {
+        std::cout << "\nFAIL: p" << judgedPercentile << " of the blocks, relative to their duration, went over budget\n";
+        failed = true;
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,143 @@
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <juce_core/juce_core.h>
+
+#include <iostream>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "LilyChorusCore.h"
+#include "ToolOptions.h"
+
+// Times the chorus through the C API, so nothing but the DSP core itself looks
+// after denormals, while a phrase of noise is played and then left to ring out
+// through heavy feedback and the high-pass filter. Reports the cost of each second
+// of the tail against the phrase, for both sample types, and exits non-zero if any
+// second of the tail costs more than --max-ratio times as much.
+
+namespace
+{
+    constexpr const char *usage = "Usage: LilyChorusTailBenchmark [--sample-rate=48000] [--block=256] [--phrase=2]\n"
+                                  "                               [--tail=30] [--feedback=0.95] [--max-ratio=1.5]\n";
+
+    struct Settings
+    {
+        double sampleRate;
+        int blockSize, phraseBlocks, tailBlocks, blocksPerSecond;
+        double feedback, maxRatio;
+    };
+
+    template <typename SampleType>
+    lilychorus_status process(lilychorus *chorus, SampleType *const *channels, uint32_t numFrames)
+    {
+        if constexpr (std::is_same_v<SampleType, float>)
+            return lilychorus_process_planar_f32(chorus, channels, 2, numFrames);
+        else
+            return lilychorus_process_planar_f64(chorus, channels, 2, numFrames);
+    }
+
+    // Returns false if the tail got too expensive, or the chorus failed
+    template <typename SampleType>
+    bool run(const char *name, lilychorus_precision precision, const Settings &settings)
+    {
+        std::unique_ptr<lilychorus, decltype(&lilychorus_destroy)> chorus(lilychorus_create(precision), &lilychorus_destroy);
+
+        lilychorus_params params;
+        lilychorus_default_params(&params);
+        params.mix = 1.0;
+        params.feedback = settings.feedback;
+        params.enable_highpass = 1;
+
+        if (chorus == nullptr || lilychorus_prepare(chorus.get(), settings.sampleRate, (uint32_t)settings.blockSize, 2, 0) != LILYCHORUS_OK ||
+            lilychorus_set_params(chorus.get(), &params) != LILYCHORUS_OK)
+        {
+            std::cout << name << ": couldn't set up the chorus\n";
+            return false;
+        }
+
+        juce::AudioBuffer<SampleType> buffer(2, settings.blockSize);
+        juce::Random random(1);
+
+        double phraseSeconds = 0.0;
+        std::vector<double> tailSeconds((size_t)(settings.tailBlocks + settings.blocksPerSecond - 1) / (size_t)settings.blocksPerSecond, 0.0);
+
+        for (int block = 0; block < settings.phraseBlocks + settings.tailBlocks; ++block)
+        {
+            const bool inPhrase = block < settings.phraseBlocks;
+
+            for (int channel = 0; channel < 2; ++channel)
+                for (int sample = 0; sample < settings.blockSize; ++sample)
+                    buffer.setSample(channel, sample, inPhrase ? (SampleType)(random.nextFloat() - 0.5f) : (SampleType)0);
+
+            const auto startTicks = juce::Time::getHighResolutionTicks();
+
+            if (process<SampleType>(chorus.get(), buffer.getArrayOfWritePointers(), (uint32_t)settings.blockSize) != LILYCHORUS_OK)
+            {
+                std::cout << name << ": processing failed\n";
+                return false;
+            }
+
+            const auto seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+
+            if (inPhrase)
+                phraseSeconds += seconds;
+            else
+                tailSeconds[(size_t)((block - settings.phraseBlocks) / settings.blocksPerSecond)] += seconds;
+        }
+
+        // Both as the cost of one second of audio, so a short last second compares fairly
+        const auto phraseCost = phraseSeconds / settings.phraseBlocks * settings.blocksPerSecond;
+        double worstRatio = 0.0;
+
+        std::cout << name << "\n  phrase      " << juce::String(phraseCost * 1000.0, 3).paddedLeft(' ', 9) << " ms per second\n";
+
+        for (size_t second = 0; second < tailSeconds.size(); ++second)
+        {
+            const auto blocks = juce::jmin(settings.blocksPerSecond, settings.tailBlocks - (int)second * settings.blocksPerSecond);
+            const auto cost = tailSeconds[second] / blocks * settings.blocksPerSecond;
+            const auto ratio = cost / phraseCost;
+            worstRatio = juce::jmax(worstRatio, ratio);
+
+            std::cout << "  tail " << juce::String((int)second + 1).paddedLeft(' ', 4) << "s "
+                      << juce::String(cost * 1000.0, 3).paddedLeft(' ', 9) << " ms per second  x" << juce::String(ratio, 2) << "\n";
+        }
+
+        std::cout << "  worst tail second x" << juce::String(worstRatio, 2) << " the phrase\n\n";
+
+        if (worstRatio > settings.maxRatio)
+        {
+            std::cout << "FAIL: the " << name << " tail costs more than x" << juce::String(settings.maxRatio, 2) << " the phrase\n\n";
+            return false;
+        }
+
+        return true;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    juce::ArgumentList args(argc, argv);
+
+    if (printUsageIfNeeded(args, usage))
+        return 1;
+
+    Settings settings;
+    settings.sampleRate = getOption(args, "--sample-rate", 48000.0);
+    settings.blockSize = juce::jmax(1, (int)getOption(args, "--block", 256));
+    settings.blocksPerSecond = juce::jmax(1, juce::roundToInt(settings.sampleRate / settings.blockSize));
+    settings.phraseBlocks = juce::jmax(1, juce::roundToInt(getOption(args, "--phrase", 2.0) * settings.blocksPerSecond));
+    settings.tailBlocks = juce::jmax(1, juce::roundToInt(getOption(args, "--tail", 30.0) * settings.blocksPerSecond));
+    settings.feedback = getOption(args, "--feedback", 0.95);
+    settings.maxRatio = getOption(args, "--max-ratio", 1.5);
+
+    // Make sure the FPU really does handle denormals, however this process was started
+    juce::FloatVectorOperations::disableDenormalisedNumberSupport(false);
+
+    std::cout << settings.blockSize << " sample blocks at " << settings.sampleRate << " Hz, feedback " << settings.feedback
+              << ", using " << lilychorus_simd_path() << "\n\n";
+
+    const bool floatPassed = run<float>("float", LILYCHORUS_FLOAT32, settings);
+    const bool doublePassed = run<double>("double", LILYCHORUS_FLOAT64, settings);
+
+    return floatPassed && doublePassed ? 0 : 1;
+}
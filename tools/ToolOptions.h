@@ -0,0 +1,25 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+#include <iostream>
+
+// Command line handling shared by the tools
+
+// The value given for option as a number, or fallback if it wasn't given
+inline double getOption(const juce::ArgumentList &args, const juce::String &option, double fallback)
+{
+    const auto value = args.getValueForOption(option);
+    return value.isEmpty() ? fallback : value.getDoubleValue();
+}
+
+// Prints usage and returns true if the tool should stop there: --help or -h was
+// given, or fewer than numRequired arguments
+inline bool printUsageIfNeeded(const juce::ArgumentList &args, const char *usage, int numRequired = 0)
+{
+    if (args.size() >= numRequired && !args.containsOption("--help|-h"))
+        return false;
+
+    std::cout << usage;
+    return true;
+}